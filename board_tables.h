@@ -0,0 +1,15 @@
+#ifndef BOARD_TABLES_H
+#define BOARD_TABLES_H
+
+#include <stdint.h>
+
+/* Lookup tables generated at build time by gen_tables.c. Boards are indexed
+   by their ternary pattern, see gen_tables.c for the encoding. */
+#define BOARD_PATTERN_COUNT 19683
+
+extern const uint8_t line_win_table[512];
+extern const uint8_t board_state_table[BOARD_PATTERN_COUNT];
+extern const int16_t board_score_table[BOARD_PATTERN_COUNT];
+extern const int16_t macro_score_table[BOARD_PATTERN_COUNT];
+
+#endif
@@ -0,0 +1,68 @@
+#include "book.h"
+
+_Static_assert(sizeof(struct BookHeader) == 16, "the book header is 16 bytes");
+_Static_assert(sizeof(struct BookEntry) == 16, "book entries are 16 bytes");
+
+const struct BookHeader* bookHeader = 0;
+const struct BookEntry* bookEntries = 0;
+
+int book_set_memory(const void* memory, size_t size)
+{
+	const struct BookHeader* header = memory;
+	bookHeader = 0;
+	bookEntries = 0;
+
+	if(size < sizeof(*header))
+		return 0;
+	for(size_t i = 0; i < sizeof(header->magic); i++)
+	{
+		if(header->magic[i] != BOOK_MAGIC[i])
+			return 0;
+	}
+	if(header->entryCount > (size - sizeof(*header)) / sizeof(struct BookEntry))
+		return 0;
+
+	bookHeader = header;
+	bookEntries = (const struct BookEntry*)(header + 1);
+	return 1;
+}
+size_t book_entry_count()
+{
+	return bookHeader ? bookHeader->entryCount : 0;
+}
+unsigned int book_depth()
+{
+	return bookHeader ? bookHeader->depth : 0;
+}
+
+int book_probe(struct Game* game, uint8_t* cell, int* score)
+{
+	// Binary search for the first entry with a hash that isn't smaller
+	size_t low = 0;
+	size_t high = book_entry_count();
+	while(low < high)
+	{
+		size_t middle = low + (high - low) / 2;
+		if(bookEntries[middle].hash < game->hash)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	if(low == book_entry_count() || bookEntries[low].hash != game->hash)
+		return 0;
+
+	// A hash collision or a book of another engine could give a move that
+	// can't be played here
+	const struct BookEntry* entry = &bookEntries[low];
+	struct Move move;
+	if(entry->cell >= 81)
+		return 0;
+	get_move_from_cell(&move, entry->cell, game->curPlayer);
+	if(!is_valid_move(game, &move))
+		return 0;
+
+	*cell = entry->cell;
+	*score = entry->score;
+	return 1;
+}
@@ -0,0 +1,44 @@
+#ifndef BOOK_H
+#define BOOK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "engine.h"
+
+/* Opening book: the best moves of the positions of the first plies of the
+   game, found ahead of time with deep searches by 'tictactos book'. The
+   kernel gets the book as a multiboot module and looks positions up in
+   place, without copying it.
+
+   The book is a header followed by the entries, sorted by hash, all little
+   endian. Positions are found by their Zobrist key (see init_zobrist_keys),
+   so a book only fits the engine whose keys it was made with. */
+
+#define BOOK_MAGIC "TTTBOOK1"
+
+struct BookHeader
+{
+	char magic[8];			// BOOK_MAGIC without its 0
+	uint32_t entryCount;
+	uint32_t depth;			// Depth the positions were searched to
+};
+struct BookEntry
+{
+	uint64_t hash;
+	uint8_t cell;			// Best move, see get_move_cell
+	uint8_t reserved[3];
+	int32_t score;			// For the player to move
+};
+
+// Uses the book in memory, returns 0 if it isn't a valid book. The memory
+// has to stay as it is while the book is used.
+int book_set_memory(const void* memory, size_t size);
+size_t book_entry_count();
+unsigned int book_depth();
+
+// Looks the position up and returns 1 with the move and its score when it
+// is in the book and the move is valid.
+int book_probe(struct Game* game, uint8_t* cell, int* score);
+
+#endif
@@ -13,15 +13,52 @@
 
 .section .bootstrap_stack, "aw", @nobits
 stack_bottom:
-.skip 16384 # 16 KiB
+.skip 66560 # 65 KiB, a KiB per ply of the search like CPU_STACK_SIZE in kernel.c
 stack_top:
 
+# A flat GDT: a code and a data segment that both cover all 4GB. The
+# bootloader's GDT can't be relied on, and the other CPUs need one too.
+.section .data
+.align 8
+.global gdt
+gdt:
+.quad 0x0000000000000000        # null descriptor
+.quad 0x00CF9A000000FFFF        # 0x08: code, ring 0
+.quad 0x00CF92000000FFFF        # 0x10: data, ring 0
+gdt_end:
+
+gdt_descriptor:
+.word gdt_end - gdt - 1
+.long gdt
+
+# Set to 1 by enable_sse when the CPU has SSE2, the kernel only uses SSE
+# then. The interrupt handlers save the SSE registers when it's set.
+.global sseEnabled
+sseEnabled:
+.byte 0
+
 .section .text
 .global _start
 .type _start, @function
 _start:
 	movl $stack_top, %esp
 
+	# Load our own GDT, leaving eax and ebx alone as they hold the multiboot
+	# magic number and information.
+	lgdt gdt_descriptor
+	ljmp $0x08, $.Lreload_segments
+.Lreload_segments:
+	movw $0x10, %cx
+	movw %cx, %ds
+	movw %cx, %es
+	movw %cx, %fs
+	movw %cx, %gs
+	movw %cx, %ss
+
+	# kernel_main(magic, multiboot information)
+	pushl %ebx
+	pushl %eax
+	call enable_sse
 	call kernel_main
 
 	cli
@@ -30,3 +67,35 @@ _start:
 	jmp .Lhang
 
 .size _start, . - _start
+
+# Enables SSE on this CPU when it has SSE2 and fxsave: clears CR0.EM so SSE
+# instructions don't trap, sets CR0.MP, and sets CR4.OSFXSR and
+# CR4.OSXMMEXCPT to tell the CPU the kernel saves the SSE registers with
+# fxsave and handles SIMD exceptions. Every CPU calls it, the boot CPU
+# before kernel_main and the others before ap_main.
+.set CPUID_FXSR, 1 << 24
+.set CPUID_SSE, 1 << 25
+.set CPUID_SSE2, 1 << 26
+.global enable_sse
+.type enable_sse, @function
+enable_sse:
+	pushl %ebx
+	movl $1, %eax
+	cpuid
+	andl $(CPUID_FXSR | CPUID_SSE | CPUID_SSE2), %edx
+	cmpl $(CPUID_FXSR | CPUID_SSE | CPUID_SSE2), %edx
+	jne .Lno_sse
+
+	movl %cr0, %eax
+	andl $~(1 << 2), %eax       # EM
+	orl $(1 << 1), %eax         # MP
+	movl %eax, %cr0
+	movl %cr4, %eax
+	orl $(1 << 9 | 1 << 10), %eax # OSFXSR and OSXMMEXCPT
+	movl %eax, %cr4
+	movb $1, sseEnabled
+.Lno_sse:
+	popl %ebx
+	ret
+
+.size enable_sse, . - enable_sse
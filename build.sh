@@ -1,5 +1,36 @@
 #!/bin/bash
 
+# build.sh         builds the kernel and the iso in build/
+# build.sh hosted  builds the engine as a static library and the command line
+#                  tool for the build machine in build-hosted/. Extra compiler
+#                  flags, like -fsanitize=address, can be passed in CFLAGS.
+
+if [ "$1" == "hosted" ]; then
+  if [ -d "build-hosted" ]; then
+    rm -rf build-hosted
+  fi
+
+  mkdir build-hosted
+  cd build-hosted
+
+  HOSTED_CFLAGS="-std=gnu99 -Wall -Wextra -O2 -g $CFLAGS"
+
+  gcc ../gen_tables.c -o gen_tables -std=gnu99 -Wall -Wextra || exit 1
+  ./gen_tables > board_tables.c
+
+  gcc -c ../engine.c -o engine.o -I.. $HOSTED_CFLAGS || exit 1
+  gcc -c ../protocol.c -o protocol.o -I.. $HOSTED_CFLAGS || exit 1
+  gcc -c ../match.c -o match.o -I.. $HOSTED_CFLAGS || exit 1
+  gcc -c ../book.c -o book.o -I.. $HOSTED_CFLAGS || exit 1
+  gcc -c ../solver.c -o solver.o -I.. $HOSTED_CFLAGS || exit 1
+  gcc -c ../mcts.c -o mcts.o -I.. $HOSTED_CFLAGS || exit 1
+  gcc -c board_tables.c -o board_tables.o -I.. $HOSTED_CFLAGS || exit 1
+  ar rcs libengine.a engine.o protocol.o match.o book.o solver.o mcts.o board_tables.o
+
+  gcc ../cli.c -o tictactos -I.. $HOSTED_CFLAGS -L. -lengine -lpthread || exit 1
+  exit 0
+fi
+
 #Set environment variables
 export PREFIX="$HOME/opt/cross"
 export TARGET=i686-elf
@@ -14,19 +45,39 @@ fi
 mkdir build
 cd build
 
-#compile the boot loader
+#compile the boot loader, the interrupt entry points and the startup code of the other CPUs
 i686-elf-as ../boot.s -o boot.o
+i686-elf-as ../interrupts.s -o interrupts.o
+i686-elf-as ../smp.s -o smp.o
 
-#compile the kernel
+#generate the board lookup tables, the generator runs on the build machine
+gcc ../gen_tables.c -o gen_tables -std=gnu99 -Wall -Wextra
+./gen_tables > board_tables.c
+
+#compile the kernel, its memory functions, the game engine, the engine protocol, self-play matches, the opening book, the endgame solver and the Monte Carlo search
 i686-elf-gcc -c ../kernel.c -o kernel.o -std=gnu99 -ffreestanding -Wall -Wextra
+i686-elf-gcc -c ../memory.c -o memory.o -std=gnu99 -ffreestanding -Wall -Wextra
+i686-elf-gcc -c ../engine.c -o engine.o -std=gnu99 -ffreestanding -Wall -Wextra
+i686-elf-gcc -c ../protocol.c -o protocol.o -std=gnu99 -ffreestanding -Wall -Wextra
+i686-elf-gcc -c ../match.c -o match.o -std=gnu99 -ffreestanding -Wall -Wextra
+i686-elf-gcc -c ../book.c -o book.o -std=gnu99 -ffreestanding -Wall -Wextra
+i686-elf-gcc -c ../solver.c -o solver.o -std=gnu99 -ffreestanding -Wall -Wextra
+i686-elf-gcc -c ../mcts.c -o mcts.o -std=gnu99 -ffreestanding -Wall -Wextra
+i686-elf-gcc -c board_tables.c -o board_tables.o -I.. -std=gnu99 -ffreestanding -Wall -Wextra
 
 #link the boot loader and kernel
-i686-elf-gcc -T ../linker.ld -o myos.bin -ffreestanding -nostdlib boot.o kernel.o -lgcc
+i686-elf-gcc -T ../linker.ld -o myos.bin -ffreestanding -nostdlib boot.o interrupts.o smp.o kernel.o memory.o engine.o protocol.o match.o book.o solver.o mcts.o board_tables.o -lgcc
+
+#build the opening book with the engine built for the build machine, the
+#searches take a minute or two
+(cd .. && bash build.sh hosted) || exit 1
+../build-hosted/tictactos book -book book.bin -threads "$(nproc)" || exit 1
 
 #build the iso
 mkdir isodir
 mkdir isodir/boot
 cp myos.bin isodir/boot/myos.bin
+cp book.bin isodir/boot/book.bin
 mkdir isodir/boot/grub
 cp ../grub.cfg isodir/boot/grub/grub.cfg
 grub-mkrescue /usr/lib/grub/i386-pc -o myos.iso isodir
@@ -0,0 +1,739 @@
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "book.h"
+#include "engine.h"
+#include "match.h"
+#include "mcts.h"
+#include "protocol.h"
+#include "solver.h"
+
+/* Command line tool around the game engine for the build machine, so the
+   search can be benchmarked and profiled without booting the kernel. */
+
+static const size_t DEFAULT_HASH_MB = 64;
+static const int DEFAULT_BENCH_DEPTH = 9;
+static const int BENCH_POSITIONS = 40;
+static const uint32_t DEFAULT_MOVE_TIME_MS = 1000;
+static const int DEFAULT_PERFT_DEPTH = 5;
+static const unsigned int DEFAULT_MATCH_GAMES = 100;
+static const int DEFAULT_MATCH_DEPTH = 6;
+static const unsigned int DEFAULT_OPENING_PLIES = 4;
+static const size_t MATCH_HASH_KB = 1024;
+static const size_t SOLVER_MB = 64;
+static const size_t MCTS_MB = 16;
+static const unsigned int DEFAULT_BOOK_PLIES = 2;
+static const int DEFAULT_BOOK_DEPTH = 10;
+
+uint32_t timer_get_ms()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint32_t)(now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
+
+// Input of the protocol command. It's read straight from the file
+// descriptor, not through stdio, so search_poll_stop can see if a line is
+// waiting without blocking.
+char inputBuffer[4096];
+size_t inputLength = 0;
+int inputClosed = 0;
+
+void input_fill(int timeoutMs)
+{
+	struct pollfd pollInput = { STDIN_FILENO, POLLIN, 0 };
+	if(inputClosed || inputLength == sizeof(inputBuffer) || poll(&pollInput, 1, timeoutMs) <= 0)
+		return;
+
+	ssize_t count = read(STDIN_FILENO, inputBuffer + inputLength, sizeof(inputBuffer) - inputLength);
+	if(count <= 0)
+		inputClosed = 1;
+	else
+		inputLength += count;
+}
+int input_has_line()
+{
+	// A full buffer counts as a line, so a long line can't get stuck
+	return memchr(inputBuffer, '\n', inputLength) != 0 || inputLength == sizeof(inputBuffer);
+}
+int input_read_line(char* line, size_t size)
+{
+	// Waits for the next line and returns it without the line end, returns
+	// 0 once the input has been closed.
+	while(!input_has_line() && !inputClosed)
+		input_fill(-1);
+	if(inputLength == 0)
+		return 0;
+
+	char* end = memchr(inputBuffer, '\n', inputLength);
+	size_t length = end ? (size_t)(end - inputBuffer) : inputLength;
+	size_t used = end ? length + 1 : length;
+
+	if(length >= size)
+		length = size - 1;
+	memcpy(line, inputBuffer, length);
+	line[length] = 0;
+	if(length > 0 && line[length - 1] == '\r')
+		line[length - 1] = 0;
+
+	memmove(inputBuffer, inputBuffer + used, inputLength - used);
+	inputLength -= used;
+	return 1;
+}
+
+int search_poll_stop()
+{
+	// A protocol search stops when "stop" or "quit" comes in. It doesn't stop
+	// when the input is closed, so a script can pipe in its commands at once.
+	if(!protocolSearching)
+		return 0;
+
+	input_fill(0);
+	size_t start = 0;
+	while(start < inputLength)
+	{
+		char* end = memchr(inputBuffer + start, '\n', inputLength - start);
+		if(!end)
+			break;
+
+		size_t length = end - (inputBuffer + start);
+		if(protocol_line_stops_search(inputBuffer + start, length))
+			return 1;
+		start += length + 1;
+	}
+	return 0;
+}
+void protocol_write(const char* text)
+{
+	fputs(text, stdout);
+	fflush(stdout);
+}
+
+// Search threads 1 and up run here, like the other CPUs do in the kernel
+pthread_t helperThreads[MAX_SEARCH_THREADS];
+volatile int helpersStop = 0;
+
+void* helper_main(void* argument)
+{
+	size_t threadIndex = (size_t)argument;
+	while(!helpersStop)
+	{
+		if(!search_help(threadIndex))
+			sched_yield();
+	}
+	return 0;
+}
+void start_helpers(size_t threadCount)
+{
+	if(threadCount < 1)
+		threadCount = 1;
+	if(threadCount > MAX_SEARCH_THREADS)
+		threadCount = MAX_SEARCH_THREADS;
+
+	searchThreadCount = threadCount;
+	for(size_t i = 1; i < threadCount; i++)
+		pthread_create(&helperThreads[i], 0, helper_main, (void*)i);
+}
+void stop_helpers()
+{
+	helpersStop = 1;
+	for(size_t i = 1; i < searchThreadCount; i++)
+		pthread_join(helperThreads[i], 0);
+}
+
+int bench(int depth, unsigned int nodeLimit)
+{
+	// Collect positions from a game played with shallow searches, then
+	// search every one of them to the given depth with an empty table. The
+	// Monte Carlo search searches each until its tree is full, or for the
+	// node limit, which counts playouts. Both engines get the same positions.
+	struct Game positions[BENCH_POSITIONS];
+	int positionCount = 0;
+
+	uint8_t savedMcts = useMcts;
+	useMcts = 0;
+	struct Game game;
+	reset_game(&game);
+	while(positionCount < BENCH_POSITIONS && get_winning_player(&game) == UNDECIDED)
+	{
+		positions[positionCount++] = game;
+
+		int score;
+		play_cell(&game, search_game(&game, 4, 0xFFFFFFFF, &score));
+	}
+	useMcts = savedMcts;
+
+	uint64_t nodes = 0;
+	uint64_t playouts = 0;
+	searchNodeLimit = nodeLimit;
+	uint32_t startMs = timer_get_ms();
+	for(int i = 0; i < positionCount; i++)
+	{
+		tt_clear();
+
+		int score;
+		search_game(&positions[i], depth, 0xFFFFFFFF, &score);
+		nodes += totalCalls;
+
+		struct SearchStats stats;
+		search_get_stats(&stats);
+		playouts += stats.playouts;
+	}
+	uint32_t elapsedMs = timer_get_ms() - startMs;
+	searchNodeLimit = 0;
+
+	printf("Positions: %d\n", positionCount);
+	printf("Depth: %d\n", depth);
+	printf("Threads: %zu\n", searchThreadCount);
+	printf("Nodes: %llu\n", (unsigned long long)nodes);
+	printf("Time ms: %u\n", elapsedMs);
+	printf("Nodes/s: %llu\n", (unsigned long long)(elapsedMs ? nodes * 1000 / elapsedMs : 0));
+	if(playouts)
+	{
+		printf("Playouts: %llu\n", (unsigned long long)playouts);
+		printf("Playouts/s: %llu\n", (unsigned long long)(elapsedMs ? playouts * 1000 / elapsedMs : 0));
+	}
+	return 0;
+}
+
+int play(uint32_t moveTimeMs)
+{
+	// The engine plays a game against itself
+	struct Game game;
+	reset_game(&game);
+	while(get_winning_player(&game) == UNDECIDED)
+	{
+		int score;
+		uint8_t cell;
+		if(book_probe(&game, &cell, &score))
+		{
+			char cellText[3];
+			cell_to_string(cell, cellText);
+			printf("%c %s book score %d\n", game.curPlayer == PLAYER1 ? 'X' : 'O', cellText, score);
+			play_cell(&game, cell);
+			continue;
+		}
+
+		cell = search_game(&game, MAX_SEARCH_DEPTH, moveTimeMs, &score);
+
+		struct SearchStats stats;
+		search_get_stats(&stats);
+		char cellText[3];
+		cell_to_string(cell, cellText);
+		if(stats.playouts)
+		{
+			printf("%c %s depth %2d playouts %9u playouts/s %9llu score %d\n", game.curPlayer == PLAYER1 ? 'X' : 'O', cellText, stats.depth, stats.playouts,
+				(unsigned long long)(stats.timeMs ? (uint64_t)stats.playouts * 1000 / stats.timeMs : 0), score);
+			play_cell(&game, cell);
+			continue;
+		}
+		printf("%c %s depth %2d nodes %9u nps %9llu cutoff%% %5.1f firstcutoff%% %5.1f branching %5.2f score %d%s\n",
+			game.curPlayer == PLAYER1 ? 'X' : 'O', cellText, stats.depth, stats.nodes,
+			(unsigned long long)(stats.timeMs ? (uint64_t)stats.nodes * 1000 / stats.timeMs : 0),
+			stats.expandedNodes ? 100.0 * stats.betaCutoffs / stats.expandedNodes : 0.0,
+			stats.betaCutoffs ? 100.0 * stats.firstMoveCutoffs / stats.betaCutoffs : 0.0,
+			stats.expandedNodes ? (double)stats.movesSearched / stats.expandedNodes : 0.0, score, stats.solved ? " solved" : "");
+
+		play_cell(&game, cell);
+	}
+
+	enum board_state winner = get_winning_player(&game);
+	printf("Result: %s\n", winner == PLAYER1_WIN ? "X wins" : winner == PLAYER2_WIN ? "O wins" : "draw");
+	return 0;
+}
+
+struct BookPosition
+{
+	struct Game game;
+	struct BookEntry entry;
+};
+struct BookPosition* bookPositions;
+size_t bookPositionCount = 0;
+size_t bookPositionCapacity = 0;
+
+void collect_book_positions(struct Game* game, unsigned int plies)
+{
+	// Every undecided position up to the given number of plies, positions
+	// reached in more than one way are removed later
+	if(get_winning_player(game) != UNDECIDED)
+		return;
+
+	if(bookPositionCount == bookPositionCapacity)
+	{
+		bookPositionCapacity = bookPositionCapacity ? bookPositionCapacity * 2 : 1024;
+		bookPositions = realloc(bookPositions, bookPositionCapacity * sizeof(*bookPositions));
+		if(!bookPositions)
+		{
+			fprintf(stderr, "Not enough memory for the book positions\n");
+			exit(1);
+		}
+	}
+	bookPositions[bookPositionCount].game = *game;
+	bookPositions[bookPositionCount].entry.hash = game->hash;
+	bookPositionCount++;
+
+	if(plies == 0)
+		return;
+
+	struct MoveList moveList;
+	put_moves_for_game(game, &moveList);
+	for(unsigned int i = 0; i < moveList.count; i++)
+	{
+		do_move(game, &moveList.moves[i]);
+		collect_book_positions(game, plies - 1);
+		undo_move(game, &moveList.moves[i]);
+	}
+}
+int compare_book_positions(const void* a, const void* b)
+{
+	uint64_t hashA = ((const struct BookPosition*)a)->entry.hash;
+	uint64_t hashB = ((const struct BookPosition*)b)->entry.hash;
+	return hashA < hashB ? -1 : hashA > hashB;
+}
+int build_book(const char* path, unsigned int plies, int depth)
+{
+	// Search every position of the first plies to the given depth and
+	// write the best moves sorted by hash, see book.h
+	struct Game game;
+	reset_game(&game);
+	collect_book_positions(&game, plies);
+
+	qsort(bookPositions, bookPositionCount, sizeof(*bookPositions), compare_book_positions);
+	size_t count = 0;
+	for(size_t i = 0; i < bookPositionCount; i++)
+	{
+		if(count == 0 || bookPositions[i].entry.hash != bookPositions[count - 1].entry.hash)
+			bookPositions[count++] = bookPositions[i];
+	}
+
+	uint32_t startMs = timer_get_ms();
+	for(size_t i = 0; i < count; i++)
+	{
+		// Every position with an empty table, so the book doesn't depend on
+		// the order the positions are searched in
+		tt_clear();
+
+		int score;
+		struct BookEntry* entry = &bookPositions[i].entry;
+		memset(entry, 0, sizeof(*entry));
+		entry->hash = bookPositions[i].game.hash;
+		entry->cell = search_game(&bookPositions[i].game, depth, 0xFFFFFFFF, &score);
+		entry->score = score;
+
+		fprintf(stderr, "\rSearched %zu of %zu positions", i + 1, count);
+	}
+	fprintf(stderr, "\n");
+
+	FILE* file = fopen(path, "wb");
+	if(!file)
+	{
+		fprintf(stderr, "Can't write %s\n", path);
+		return 1;
+	}
+
+	struct BookHeader header;
+	memcpy(header.magic, BOOK_MAGIC, sizeof(header.magic));
+	header.entryCount = count;
+	header.depth = depth;
+	fwrite(&header, sizeof(header), 1, file);
+	for(size_t i = 0; i < count; i++)
+		fwrite(&bookPositions[i].entry, sizeof(struct BookEntry), 1, file);
+	if(fclose(file) != 0)
+	{
+		fprintf(stderr, "Can't write %s\n", path);
+		return 1;
+	}
+
+	printf("Positions: %zu\n", count);
+	printf("Plies: %u\n", plies);
+	printf("Depth: %d\n", depth);
+	printf("Time ms: %u\n", timer_get_ms() - startMs);
+	printf("Size bytes: %zu\n", sizeof(header) + count * sizeof(struct BookEntry));
+	return 0;
+}
+int load_book(const char* path)
+{
+	// The book stays in memory for the rest of the run
+	FILE* file = fopen(path, "rb");
+	if(!file)
+	{
+		fprintf(stderr, "Can't read %s\n", path);
+		return 0;
+	}
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	void* memory = malloc(size > 0 ? size : 1);
+	int valid = memory && fread(memory, 1, size, file) == (size_t)size && book_set_memory(memory, size);
+	fclose(file);
+	if(!valid)
+		fprintf(stderr, "%s isn't a valid book\n", path);
+	return valid;
+}
+
+int perft_position(const char* moves, int depth, int divide)
+{
+	struct Game game;
+	reset_game(&game);
+	if(play_moves(&game, moves) < 0)
+	{
+		fprintf(stderr, "Invalid moves: %s\n", moves);
+		return 1;
+	}
+
+	uint64_t counts[81];
+	uint32_t startMs = timer_get_ms();
+	uint64_t nodes = divide ? perft_divide(&game, depth, counts) : perft(&game, depth);
+	uint32_t elapsedMs = timer_get_ms() - startMs;
+
+	if(divide)
+	{
+		for(int cell = 0; cell < 81; cell++)
+		{
+			if(!counts[cell])
+				continue;
+
+			char text[3];
+			cell_to_string(cell, text);
+			printf("%s: %llu\n", text, (unsigned long long)counts[cell]);
+		}
+	}
+
+	printf("Depth: %d\n", depth);
+	printf("Nodes: %llu\n", (unsigned long long)nodes);
+	printf("Time ms: %u\n", elapsedMs);
+	printf("Nodes/s: %llu\n", (unsigned long long)(elapsedMs ? nodes * 1000 / elapsedMs : 0));
+	return 0;
+}
+int perft_suite()
+{
+	// Check the move generation against the known counts of the reference positions
+	int failures = 0;
+	for(size_t i = 0; i < perftPositionCount; i++)
+	{
+		const struct PerftPosition* position = &perftPositions[i];
+
+		struct Game game;
+		reset_game(&game);
+		play_moves(&game, position->moves);
+
+		uint32_t startMs = timer_get_ms();
+		uint64_t nodes = perft(&game, position->depth);
+		uint32_t elapsedMs = timer_get_ms() - startMs;
+
+		int ok = nodes == position->nodes;
+		failures += !ok;
+		printf("%-16s depth %d nodes %10llu expected %10llu %s %6u ms %10llu nodes/s\n",
+			position->name, position->depth, (unsigned long long)nodes, (unsigned long long)position->nodes,
+			ok ? "OK  " : "FAIL", elapsedMs, (unsigned long long)(elapsedMs ? nodes * 1000 / elapsedMs : 0));
+	}
+
+	printf("%s\n", failures ? "Perft FAILED" : "Perft OK");
+
+	// Check the endgame solver against a plain negamax on the reference endgames
+	int solverFailures = 0;
+	for(size_t i = 0; i < solverPositionCount; i++)
+	{
+		const struct SolverPosition* position = &solverPositions[i];
+
+		struct SolverResult solved = { 0, 0, 0 };
+		struct SolverResult negamax = { 0, 0, 0 };
+		unsigned int nodes = 0;
+		uint32_t startMs = timer_get_ms();
+		int ok = solver_check(position, &solved, &negamax, &nodes);
+		uint32_t elapsedMs = timer_get_ms() - startMs;
+
+		solverFailures += !ok;
+		printf("%-16s solver %2d %2d negamax %2d %2d expected %2d %2d %s %6u ms %10u nodes\n",
+			position->name, solved.value, solved.distance, negamax.value, negamax.distance,
+			position->value, position->distance, ok ? "OK  " : "FAIL", elapsedMs, nodes);
+	}
+
+	printf("%s\n", solverFailures ? "Solver FAILED" : "Solver OK");
+	return failures || solverFailures ? 1 : 0;
+}
+
+int protocol()
+{
+	// Speak the engine protocol on stdin and stdout until "quit"
+	protocol_initialize();
+
+	char line[sizeof(inputBuffer)];
+	while(input_read_line(line, sizeof(line)))
+	{
+		if(!protocol_handle_line(line))
+			break;
+	}
+	return 0;
+}
+
+void print_text(const char* text)
+{
+	fputs(text, stdout);
+	fflush(stdout);
+}
+void print_engine_config(const struct EngineConfig* config)
+{
+	printf("Engine %s: depth %zu", config->name, config->maxDepth);
+	if(config->moveTimeMs != 0xFFFFFFFF)
+		printf(", %u ms per move", config->moveTimeMs);
+	if(config->nodes)
+		printf(", %u nodes per move", config->nodes);
+	printf("%s%s%s%s%s%s\n", config->useMoveOrdering ? "" : ", no move ordering", config->useMacroEval ? "" : ", no macro evaluation",
+		config->useSimdEval ? ", SIMD evaluation" : "", config->useSolver ? "" : ", no solver", config->usePvs ? "" : ", no PVS",
+		config->useMcts ? ", Monte Carlo search" : "");
+}
+int match(const struct EngineConfig* engineA, const struct EngineConfig* engineB, unsigned int games, unsigned int openingPlies, uint32_t seed)
+{
+	print_engine_config(engineA);
+	print_engine_config(engineB);
+
+	struct MatchResult result;
+	match_play(engineA, engineB, games, openingPlies, seed, print_text, &result);
+	match_write_summary(&result, print_text);
+	return 0;
+}
+
+void usage()
+{
+	fprintf(stderr,
+		"Usage: tictactos <command> [options]\n"
+		"Commands:\n"
+		"  bench    search %d positions to a fixed depth and report nodes/s\n"
+		"  play     let the engine play a game against itself\n"
+		"  perft    count the positions up to a depth from a position\n"
+		"  suite    check perft and the endgame solver on the reference positions\n"
+		"  protocol speak the engine protocol on stdin and stdout (see protocol.h)\n"
+		"  match    play games between engine A and engine B\n"
+		"  book     search the positions of the first plies and write the opening book\n"
+		"Options:\n"
+		"  -depth N     search depth of bench (default %d) or perft (default %d)\n"
+		"  -moves S     moves to the perft position, like \"55 51 15\"\n"
+		"  -divide      print the perft count of every move\n"
+		"  -movetime N  milliseconds per move of play (default %u)\n"
+		"  -threads N   search threads (default 1)\n"
+		"  -hash N      transposition table size in MB (default %zu)\n"
+		"  -noordering  search without move ordering\n"
+		"  -book FILE   opening book that play uses, or that book writes\n"
+		"  -plies N     plies of the positions in the book (default %u, depth default %d)\n"
+		"  -simdeval    evaluate whole positions with SSE2\n"
+		"  -nosolver    search to the end of the game without the endgame solver\n"
+		"  -nopvs       plain alpha-beta, every move with the full window\n"
+		"  -mcts        Monte Carlo tree search instead of alpha-beta, without a\n"
+		"               time or node limit it searches until its tree is full\n"
+		"Options of match, the ones above set up engine A:\n"
+		"  -games N          games to play (default %u)\n"
+		"  -openingplies N   random moves of every opening (default %u)\n"
+		"  -seed N           seed of the openings\n"
+		"  -nodes N          node limit per move, bench uses it too\n"
+		"  -nomacroeval      evaluate the boards on their own only\n"
+		"  -depth2 N, -movetime2 N, -nodes2 N, -noordering2, -nomacroeval2,\n"
+		"  -simdeval2, -nosolver2, -nopvs2, -mcts2\n"
+		"                    engine B, which is the same as engine A otherwise\n"
+		"Match depth defaults to %d without a time limit. The engines use %zu KB\n"
+		"of transposition table, cleared before every move.\n",
+		BENCH_POSITIONS, DEFAULT_BENCH_DEPTH, DEFAULT_PERFT_DEPTH, DEFAULT_MOVE_TIME_MS, DEFAULT_HASH_MB,
+		DEFAULT_BOOK_PLIES, DEFAULT_BOOK_DEPTH,
+		DEFAULT_MATCH_GAMES, DEFAULT_OPENING_PLIES, DEFAULT_MATCH_DEPTH, MATCH_HASH_KB);
+}
+
+int main(int argc, char** argv)
+{
+	if(argc < 2)
+	{
+		usage();
+		return 1;
+	}
+
+	const char* command = argv[1];
+	int depth = 0;
+	const char* moves = "";
+	int divide = 0;
+	uint32_t moveTimeMs = 0;
+	size_t threadCount = 1;
+	size_t hashMb = DEFAULT_HASH_MB;
+	const char* bookPath = 0;
+	unsigned int bookPlies = DEFAULT_BOOK_PLIES;
+
+	unsigned int games = DEFAULT_MATCH_GAMES;
+	unsigned int openingPlies = DEFAULT_OPENING_PLIES;
+	uint32_t seed = 1;
+	unsigned int nodes = 0;
+	// Settings of engine B, -1 when they're the same as for engine A
+	int depth2 = -1;
+	int moveTimeMs2 = -1;
+	int nodes2 = -1;
+	int useMoveOrdering2 = -1;
+	int useMacroEval2 = -1;
+	int useSimdEval2 = -1;
+	int useSolver2 = -1;
+	int usePvs2 = -1;
+	int useMcts2 = -1;
+
+	for(int i = 2; i < argc; i++)
+	{
+		int hasValue = i + 1 < argc;
+		if(strcmp(argv[i], "-depth") == 0 && hasValue)
+			depth = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-movetime") == 0 && hasValue)
+			moveTimeMs = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-threads") == 0 && hasValue)
+			threadCount = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-hash") == 0 && hasValue)
+			hashMb = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-moves") == 0 && hasValue)
+			moves = argv[++i];
+		else if(strcmp(argv[i], "-divide") == 0)
+			divide = 1;
+		else if(strcmp(argv[i], "-book") == 0 && hasValue)
+			bookPath = argv[++i];
+		else if(strcmp(argv[i], "-plies") == 0 && hasValue)
+			bookPlies = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-noordering") == 0)
+			useMoveOrdering = 0;
+		else if(strcmp(argv[i], "-simdeval") == 0)
+			useSimdEval = 1;
+		else if(strcmp(argv[i], "-nosolver") == 0)
+			useSolver = 0;
+		else if(strcmp(argv[i], "-nopvs") == 0)
+			usePvs = 0;
+		else if(strcmp(argv[i], "-mcts") == 0)
+			useMcts = 1;
+		else if(strcmp(argv[i], "-games") == 0 && hasValue)
+			games = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-openingplies") == 0 && hasValue)
+			openingPlies = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-seed") == 0 && hasValue)
+			seed = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-nodes") == 0 && hasValue)
+			nodes = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-nomacroeval") == 0)
+			useMacroEval = 0;
+		else if(strcmp(argv[i], "-depth2") == 0 && hasValue)
+			depth2 = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-movetime2") == 0 && hasValue)
+			moveTimeMs2 = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-nodes2") == 0 && hasValue)
+			nodes2 = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-noordering2") == 0)
+			useMoveOrdering2 = 0;
+		else if(strcmp(argv[i], "-nomacroeval2") == 0)
+			useMacroEval2 = 0;
+		else if(strcmp(argv[i], "-simdeval2") == 0)
+			useSimdEval2 = 1;
+		else if(strcmp(argv[i], "-nosolver2") == 0)
+			useSolver2 = 0;
+		else if(strcmp(argv[i], "-nopvs2") == 0)
+			usePvs2 = 0;
+		else if(strcmp(argv[i], "-mcts2") == 0)
+			useMcts2 = 1;
+		else
+		{
+			usage();
+			return 1;
+		}
+	}
+
+	if(strcmp(command, "perft") == 0)
+		return perft_position(moves, depth > 0 ? depth : DEFAULT_PERFT_DEPTH, divide);
+
+	// Engine A plays with the normal options, engine B the same unless set
+	struct EngineConfig engineA;
+	engineA.name = "A";
+	engineA.maxDepth = depth > 0 && depth <= MAX_SEARCH_DEPTH ? depth : DEFAULT_MATCH_DEPTH;
+	engineA.moveTimeMs = moveTimeMs ? moveTimeMs : 0xFFFFFFFF;
+	engineA.nodes = nodes;
+	engineA.useMoveOrdering = useMoveOrdering;
+	engineA.useMacroEval = useMacroEval;
+	engineA.useSimdEval = useSimdEval;
+	engineA.useSolver = useSolver;
+	engineA.usePvs = usePvs;
+	engineA.useMcts = useMcts;
+	engineA.ttSize = MATCH_HASH_KB * 1024;
+
+	struct EngineConfig engineB = engineA;
+	engineB.name = "B";
+	if(depth2 > 0 && depth2 <= MAX_SEARCH_DEPTH)
+		engineB.maxDepth = depth2;
+	if(moveTimeMs2 > 0)
+		engineB.moveTimeMs = moveTimeMs2;
+	if(nodes2 >= 0)
+		engineB.nodes = nodes2;
+	if(useMoveOrdering2 >= 0)
+		engineB.useMoveOrdering = useMoveOrdering2;
+	if(useMacroEval2 >= 0)
+		engineB.useMacroEval = useMacroEval2;
+	if(useSimdEval2 >= 0)
+		engineB.useSimdEval = useSimdEval2;
+	if(useSolver2 >= 0)
+		engineB.useSolver = useSolver2;
+	if(usePvs2 >= 0)
+		engineB.usePvs = usePvs2;
+	if(useMcts2 >= 0)
+		engineB.useMcts = useMcts2;
+
+	int bookDepth = depth > 0 && depth <= MAX_SEARCH_DEPTH ? depth : DEFAULT_BOOK_DEPTH;
+	if(depth < 1 || depth > MAX_SEARCH_DEPTH)
+		depth = DEFAULT_BENCH_DEPTH;
+	if(moveTimeMs == 0)
+		moveTimeMs = DEFAULT_MOVE_TIME_MS;
+
+	size_t hashSize = tt_memory_size(hashMb * 1024 * 1024);
+	void* hashMemory = malloc(hashSize);
+	if(!hashMemory || !tt_set_memory(hashMemory, hashSize))
+	{
+		fprintf(stderr, "Not enough memory for the transposition table\n");
+		return 1;
+	}
+
+	void* solverMemory = malloc(SOLVER_MB * 1024 * 1024);
+	if(solverMemory)
+		solver_set_memory(solverMemory, SOLVER_MB * 1024 * 1024);
+
+	void* mctsMemory = malloc(MCTS_MB * 1024 * 1024);
+	if(mctsMemory)
+		mcts_set_memory(mctsMemory, MCTS_MB * 1024 * 1024);
+
+	search_initialize();
+	start_helpers(threadCount);
+
+	int result;
+	if(strcmp(command, "suite") == 0)
+		result = perft_suite();
+	else if(strcmp(command, "bench") == 0)
+		result = bench(depth, nodes);
+	else if(strcmp(command, "play") == 0)
+		result = bookPath && !load_book(bookPath) ? 1 : play(moveTimeMs);
+	else if(strcmp(command, "book") == 0)
+	{
+		if(bookPath)
+			result = build_book(bookPath, bookPlies, bookDepth);
+		else
+		{
+			fprintf(stderr, "The book needs a file, see -book\n");
+			result = 1;
+		}
+	}
+	else if(strcmp(command, "protocol") == 0)
+		result = protocol();
+	else if(strcmp(command, "match") == 0)
+		result = match(&engineA, &engineB, games, openingPlies, seed);
+	else
+	{
+		usage();
+		result = 1;
+	}
+
+	stop_helpers();
+	free(hashMemory);
+	free(solverMemory);
+	free(mctsMemory);
+	return result;
+}
@@ -0,0 +1,1641 @@
+#include "engine.h"
+#include "board_tables.h"
+#include "solver.h"
+#include "mcts.h"
+
+static const uint16_t POWERS_OF_THREE[9] = { 1, 3, 9, 27, 81, 243, 729, 2187, 6561 };
+
+// Zobrist keys used to hash a position: one key for every piece of every
+// player on every cell, one per board the next player is forced to play in
+// (index 9 when the player may choose freely) and one for player 2 to move.
+uint64_t zobrist_piece_keys[2][81];
+uint64_t zobrist_forced_board_keys[10];
+uint64_t zobrist_player2_key;
+
+uint64_t next_random_key(uint64_t* state)
+{
+	// xorshift64*, seeded with a fixed value so the keys are the same on every boot
+	uint64_t x = *state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	return x * 0x2545F4914F6CDD1DULL;
+}
+uint32_t next_random(uint32_t* state)
+{
+	// xorshift32
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+uint32_t isqrt(uint64_t x)
+{
+	uint64_t result = 0;
+	for(uint64_t bit = (uint64_t)1 << 62; bit > 0; bit >>= 2)
+	{
+		if(x >= result + bit)
+		{
+			x -= result + bit;
+			result = (result >> 1) + bit;
+		}
+		else
+			result >>= 1;
+	}
+	return (uint32_t)result;
+}
+void init_zobrist_keys()
+{
+	uint64_t state = 0x9E3779B97F4A7C15ULL;
+
+	for(int player = 0; player < 2; player++)
+	{
+		for(int cell = 0; cell < 81; cell++)
+			zobrist_piece_keys[player][cell] = next_random_key(&state);
+	}
+	for(int i = 0; i < 10; i++)
+		zobrist_forced_board_keys[i] = next_random_key(&state);
+	zobrist_player2_key = next_random_key(&state);
+}
+
+enum board_piece get_board_piece(struct Board* board, uint8_t index)
+{
+	uint16_t bit = 1 << index;
+	if(board->pieces[0] & bit)
+		return PLAYER1;
+	else if(board->pieces[1] & bit)
+		return PLAYER2;
+	return NONE;
+}
+
+void reset_gameboard(struct Board* board)
+{
+	board->state = UNDECIDED;
+	board->pattern = 0;
+	board->pieces[0] = 0;
+	board->pieces[1] = 0;
+}
+void reset_game(struct Game* game)
+{
+	game->curBoardXIndex = 0xFF;
+	game->curBoardYIndex = 0xFF;
+	game->curPlayer = PLAYER1;
+	game->wonBoards[0] = 0;
+	game->wonBoards[1] = 0;
+	game->decidedBoards = 0;
+	game->macroPattern = 0;
+	game->evalScore = 0;
+	game->hash = zobrist_forced_board_keys[9];
+	for(uint8_t i = 0; i < 9; i++)
+	{
+		reset_gameboard(&game->boards[i]);
+	}
+}
+
+void put_moves_for_board(struct Board* board, int boardX, int boardY, enum board_piece player, struct MoveList* moveList)
+{
+	if(board->state != UNDECIDED)
+		return;
+
+	// Every bit that is not set in either player mask is an empty position
+	// where a piece can be placed. Walk them from the lowest bit up so the
+	// moves come out in the same y, x order as the board layout.
+	uint16_t emptyMask = ~(board->pieces[0] | board->pieces[1]) & FULL_BOARD_MASK;
+	while(emptyMask)
+	{
+		int index = __builtin_ctz(emptyMask);
+		emptyMask &= emptyMask - 1;
+
+		struct Move* move = &moveList->moves[moveList->count++];
+		move->pieceXIndex = index % 3;
+		move->pieceYIndex = index / 3;
+		move->boardXIndex = boardX;
+		move->boardYIndex = boardY;
+		move->piece = player;
+	}
+}
+// Fills the move list with the moves of the current player
+void put_moves_for_game(struct Game* game, struct MoveList* moveList)
+{
+	moveList->count = 0;
+
+	// Is a game board already selected to play on?
+	if(game->curBoardXIndex == 0xFF)
+	{
+		// First move, select moves from all boards
+		for(int i = 0; i < 9; i++)
+		{
+			put_moves_for_board(&game->boards[i], i % 3, i / 3, game->curPlayer, moveList);
+		}
+	}
+	else
+	{
+		// A game board is selected, but it might be that the game board
+		// has already been resolved (win, loss, draw).
+		uint8_t boardIndex = game->curBoardYIndex * 3 + game->curBoardXIndex;
+
+		struct Board* board = &game->boards[boardIndex];
+		if(board->state == UNDECIDED)
+		{
+			// The game is undecided, we only need to add the moves for this board
+			put_moves_for_board(board, game->curBoardXIndex, game->curBoardYIndex, game->curPlayer, moveList);
+		}
+		else
+		{
+			// The current board has already been resolved, we must add
+			// the moves of all other boards instead.
+			for(int i = 0; i < 9; i++)
+			{
+				put_moves_for_board(&game->boards[i], i % 3, i / 3, game->curPlayer, moveList);
+			}
+		}
+	}
+}
+enum board_piece get_next_player(enum board_piece player)
+{
+	return player == PLAYER1 ? PLAYER2 : PLAYER1;
+}
+uint8_t get_forced_board_index(struct Game* game)
+{
+	// Returns the board the current player has to play in, or 9 when the
+	// player may pick any board because none was selected yet or the selected
+	// board has already been resolved.
+	if(game->curBoardXIndex == 0xFF)
+		return 9;
+
+	uint8_t boardIndex = game->curBoardYIndex * 3 + game->curBoardXIndex;
+	if(game->boards[boardIndex].state != UNDECIDED)
+		return 9;
+
+	return boardIndex;
+}
+uint8_t get_move_cell(struct Move* move)
+{
+	// Index of the move on the full 9x9 game, board by board
+	return (move->boardYIndex * 3 + move->boardXIndex) * 9 + move->pieceYIndex * 3 + move->pieceXIndex;
+}
+void get_move_from_cell(struct Move* move, uint8_t cell, enum board_piece player)
+{
+	uint8_t boardIndex = cell / 9;
+	uint8_t pieceIndex = cell % 9;
+
+	move->boardXIndex = boardIndex % 3;
+	move->boardYIndex = boardIndex / 3;
+	move->pieceXIndex = pieceIndex % 3;
+	move->pieceYIndex = pieceIndex / 3;
+	move->piece = player;
+}
+void play_cell(struct Game* game, uint8_t cell)
+{
+	struct Move move;
+	get_move_from_cell(&move, cell, game->curPlayer);
+	do_move(game, &move);
+}
+// Moves are written as two digits: the board and the cell within the
+// board, both numbered 1 to 9 from the top left to the bottom right. "55" is
+// the center of the center board.
+void cell_to_string(uint8_t cell, char* result)
+{
+	result[0] = '1' + cell / 9;
+	result[1] = '1' + cell % 9;
+	result[2] = 0;
+}
+int string_to_cell(const char* text)
+{
+	if(text[0] < '1' || text[0] > '9' || text[1] < '1' || text[1] > '9')
+		return -1;
+	return (text[0] - '1') * 9 + text[1] - '1';
+}
+int play_moves(struct Game* game, const char* moves)
+{
+	// Plays a list of moves separated by spaces. Stops at the first move that
+	// is not valid and returns -1, otherwise returns the number of moves.
+	int count = 0;
+	while(*moves)
+	{
+		if(*moves == ' ')
+		{
+			moves++;
+			continue;
+		}
+
+		int cell = string_to_cell(moves);
+		if(cell < 0 || (moves[2] != 0 && moves[2] != ' ') || get_winning_player(game) != UNDECIDED)
+			return -1;
+
+		struct Move move;
+		get_move_from_cell(&move, cell, game->curPlayer);
+		if(!is_valid_move(game, &move))
+			return -1;
+
+		play_cell(game, cell);
+		moves += 2;
+		count++;
+	}
+	return count;
+}
+void update_board_state(struct Board* board)
+{
+	board->state = board_state_table[board->pattern];
+}
+
+int is_valid_move(struct Game* game, struct Move* move)
+{
+	// Check if the player is allowed to do a move
+	if(game->curPlayer != move->piece)
+		return 0;
+
+	int boardIndex = move->boardYIndex * 3 + move->boardXIndex;
+	int pieceIndex = move->pieceYIndex * 3 + move->pieceXIndex;
+
+	// Check if the board is not already resolved (win, loss, draw)
+	struct Board* board = &game->boards[boardIndex];
+	if(board->state != UNDECIDED)
+		return 0;
+
+	// Check if the position is not already taken
+	if((board->pieces[0] | board->pieces[1]) & (1 << pieceIndex))
+		return 0;
+
+	// Check if a move can be made in the current board. A move can be made if:
+	// - The game has not yet selected a board to play on
+	// - The move board X and Y index are equal to the game current board X and Y index
+	if(game->curBoardXIndex != 0xFF)
+	{
+		enum board_state state = game->boards[game->curBoardYIndex * 3 + game->curBoardXIndex].state;
+
+		if(state == UNDECIDED && (game->curBoardXIndex != move->boardXIndex || game->curBoardYIndex != move->boardYIndex))
+			return 0;
+	}
+
+	return 1;
+}
+
+void do_move(struct Game* game, struct Move* move)
+{
+	// Do the move
+	int boardIndex = move->boardYIndex * 3 + move->boardXIndex;
+	int pieceIndex = move->pieceYIndex * 3 + move->pieceXIndex;
+
+	struct Board* board = &game->boards[boardIndex];
+
+	move->prevBoardXIndex = game->curBoardXIndex;
+	move->prevBoardYIndex = game->curBoardYIndex;
+
+	game->hash ^= zobrist_forced_board_keys[get_forced_board_index(game)];
+
+	game->evalScore -= board_score_table[board->pattern];
+
+	board->pieces[move->piece - 1] |= 1 << pieceIndex;
+	board->pattern += move->piece * POWERS_OF_THREE[pieceIndex];
+
+	game->evalScore += board_score_table[board->pattern];
+	game->curBoardXIndex = move->pieceXIndex;
+	game->curBoardYIndex = move->pieceYIndex;
+	game->curPlayer = get_next_player(game->curPlayer);
+
+	update_board_state(board);
+
+	if(board->state != UNDECIDED)
+	{
+		game->decidedBoards |= 1 << boardIndex;
+		if(board->state != DRAW)
+		{
+			game->wonBoards[board->state - 1] |= 1 << boardIndex;
+
+			game->evalScore -= macro_score_table[game->macroPattern];
+			game->macroPattern += board->state * POWERS_OF_THREE[boardIndex];
+			game->evalScore += macro_score_table[game->macroPattern];
+		}
+	}
+
+	game->hash ^= zobrist_piece_keys[move->piece - 1][boardIndex * 9 + pieceIndex];
+	game->hash ^= zobrist_forced_board_keys[get_forced_board_index(game)];
+	game->hash ^= zobrist_player2_key;
+}
+void undo_move(struct Game* game, struct Move* move)
+{
+	// Do the move
+	int boardIndex = move->boardYIndex * 3 + move->boardXIndex;
+	int pieceIndex = move->pieceYIndex * 3 + move->pieceXIndex;
+
+	struct Board* board = &game->boards[boardIndex];
+
+	game->hash ^= zobrist_forced_board_keys[get_forced_board_index(game)];
+
+	if(board->state == PLAYER1_WIN || board->state == PLAYER2_WIN)
+	{
+		game->evalScore -= macro_score_table[game->macroPattern];
+		game->macroPattern -= board->state * POWERS_OF_THREE[boardIndex];
+		game->evalScore += macro_score_table[game->macroPattern];
+	}
+
+	game->evalScore -= board_score_table[board->pattern];
+
+	board->pieces[move->piece - 1] &= ~(1 << pieceIndex);
+	board->pattern -= move->piece * POWERS_OF_THREE[pieceIndex];
+
+	game->evalScore += board_score_table[board->pattern];
+	game->curBoardXIndex = move->prevBoardXIndex;
+	game->curBoardYIndex = move->prevBoardYIndex;
+	game->curPlayer = get_next_player(game->curPlayer);
+
+	// When undoing a move we can just reset the board state to UNDECIDED
+	// because no matter what, undoing a move can never result in a win or draw state.
+	board->state = UNDECIDED;
+	game->decidedBoards &= ~(1 << boardIndex);
+	game->wonBoards[0] &= ~(1 << boardIndex);
+	game->wonBoards[1] &= ~(1 << boardIndex);
+
+	game->hash ^= zobrist_piece_keys[move->piece - 1][boardIndex * 9 + pieceIndex];
+	game->hash ^= zobrist_forced_board_keys[get_forced_board_index(game)];
+	game->hash ^= zobrist_player2_key;
+}
+enum board_state get_winning_player(struct Game* game)
+{
+	// The boards won by each player form a 3x3 grid of their own, the game
+	// is won by completing a line on it.
+	if(line_win_table[game->wonBoards[0]])
+		return PLAYER1_WIN;
+	else if(line_win_table[game->wonBoards[1]])
+		return PLAYER2_WIN;
+
+	if(game->decidedBoards != FULL_BOARD_MASK)
+		return UNDECIDED;
+
+	return DRAW;
+}
+enum board_state get_winning_state(enum board_piece player)
+{
+	return player == PLAYER1 ? PLAYER1_WIN : PLAYER2_WIN;
+}
+
+// A whole position as text: the 81 cells in the order of the move notation
+// as 'x', 'o' or '.', the player to move ('x' or 'o') and the board that
+// player is forced to play in (1 to 9, 0 for any board), separated by spaces.
+// Positions that can't come up in a game, for instance with more pieces of
+// one player than the other, are accepted as they are.
+void set_player_to_move(struct Game* game, enum board_piece player)
+{
+	if(game->curPlayer != player)
+		game->hash ^= zobrist_player2_key;
+	game->curPlayer = player;
+}
+void set_forced_board(struct Game* game, uint8_t boardIndex)
+{
+	game->hash ^= zobrist_forced_board_keys[get_forced_board_index(game)];
+	game->curBoardXIndex = boardIndex < 9 ? boardIndex % 3 : 0xFF;
+	game->curBoardYIndex = boardIndex < 9 ? boardIndex / 3 : 0xFF;
+	game->hash ^= zobrist_forced_board_keys[get_forced_board_index(game)];
+}
+int game_from_string(struct Game* game, const char* text)
+{
+	// Returns the length of the position text or -1 if it's not valid
+	reset_game(game);
+	for(int cell = 0; cell < 81; cell++)
+	{
+		enum board_piece piece;
+		if(text[cell] == 'x')
+			piece = PLAYER1;
+		else if(text[cell] == 'o')
+			piece = PLAYER2;
+		else if(text[cell] == '.')
+			continue;
+		else
+			return -1;
+
+		struct Board* board = &game->boards[cell / 9];
+		board->pieces[piece - 1] |= 1 << (cell % 9);
+		board->pattern += piece * POWERS_OF_THREE[cell % 9];
+		game->hash ^= zobrist_piece_keys[piece - 1][cell];
+	}
+
+	if(text[81] != ' ' || (text[82] != 'x' && text[82] != 'o') || text[83] != ' ' || text[84] < '0' || text[84] > '9')
+		return -1;
+	if(text[85] != 0 && text[85] != ' ')
+		return -1;
+
+	// The pieces can't be placed with do_move, it expects every board to be
+	// decided by the last piece placed on it. Work out the state of the
+	// boards and the evaluation the same way it does instead.
+	for(int i = 0; i < 9; i++)
+	{
+		struct Board* board = &game->boards[i];
+		update_board_state(board);
+		game->evalScore += board_score_table[board->pattern] - board_score_table[0];
+
+		if(board->state != UNDECIDED)
+		{
+			game->decidedBoards |= 1 << i;
+			if(board->state != DRAW)
+			{
+				game->wonBoards[board->state - 1] |= 1 << i;
+				game->macroPattern += board->state * POWERS_OF_THREE[i];
+			}
+		}
+	}
+	game->evalScore += macro_score_table[game->macroPattern] - macro_score_table[0];
+
+	set_player_to_move(game, text[82] == 'x' ? PLAYER1 : PLAYER2);
+	set_forced_board(game, text[84] == '0' ? 9 : text[84] - '1');
+	return 85;
+}
+void game_to_string(struct Game* game, char* result)
+{
+	for(int cell = 0; cell < 81; cell++)
+	{
+		enum board_piece piece = get_board_piece(&game->boards[cell / 9], cell % 9);
+		result[cell] = piece == PLAYER1 ? 'x' : piece == PLAYER2 ? 'o' : '.';
+	}
+
+	uint8_t forcedBoard = get_forced_board_index(game);
+	result[81] = ' ';
+	result[82] = game->curPlayer == PLAYER1 ? 'x' : 'o';
+	result[83] = ' ';
+	result[84] = forcedBoard < 9 ? '1' + forcedBoard : '0';
+	result[85] = 0;
+}
+
+// Perft: counts the positions at the given depth from this one, to check
+// the move generation and do_move/undo_move against known counts. Decided
+// games have no moves, so they count as no positions at all.
+uint64_t perft(struct Game* game, int depth)
+{
+	if(depth == 0)
+		return 1;
+	if(get_winning_player(game) != UNDECIDED)
+		return 0;
+
+	struct MoveList moveList;
+	put_moves_for_game(game, &moveList);
+	if(depth == 1)
+		return moveList.count;
+
+	uint64_t nodes = 0;
+	for(unsigned int i = 0; i < moveList.count; i++)
+	{
+		do_move(game, &moveList.moves[i]);
+		nodes += perft(game, depth - 1);
+		undo_move(game, &moveList.moves[i]);
+	}
+	return nodes;
+}
+uint64_t perft_divide(struct Game* game, int depth, uint64_t counts[81])
+{
+	// Like perft, but also stores the count of every root move by its cell.
+	// Cells without a move are set to 0.
+	for(int cell = 0; cell < 81; cell++)
+		counts[cell] = 0;
+	if(depth == 0 || get_winning_player(game) != UNDECIDED)
+		return perft(game, depth);
+
+	struct MoveList moveList;
+	put_moves_for_game(game, &moveList);
+
+	uint64_t nodes = 0;
+	for(unsigned int i = 0; i < moveList.count; i++)
+	{
+		struct Move* move = &moveList.moves[i];
+		do_move(game, move);
+		counts[get_move_cell(move)] = perft(game, depth - 1);
+		undo_move(game, move);
+		nodes += counts[get_move_cell(move)];
+	}
+	return nodes;
+}
+
+// Without the macro evaluation only the boards on their own are scored,
+// to measure what scoring the boards as one group is worth.
+uint8_t useMacroEval = 1;
+
+// The SIMD evaluation scores the whole position from the pieces instead of
+// using the score do_move and undo_move keep up to date. It gives the exact
+// same scores, the platform may only set useSimdEval when the CPU has SSE2
+// and it has been enabled.
+uint8_t useSimdEval = 0;
+
+#if defined(__i386__) || defined(__x86_64__)
+// The kernel is built without SSE, only these functions are compiled for
+// it. The kernel doesn't keep its stacks 16 byte aligned like the SSE code
+// expects, so they align their own.
+#define SIMD_TARGET __attribute__((target("sse2"), force_align_arg_pointer))
+#else
+#define SIMD_TARGET
+#endif
+
+typedef int8_t int8x16 __attribute__((vector_size(16)));
+typedef int16_t int16x8 __attribute__((vector_size(16)));
+typedef int32_t int32x4 __attribute__((vector_size(16)));
+typedef int32_t unaligned_int32x4 __attribute__((vector_size(16), aligned(4)));
+
+// evaluate_game_simd loads the boards with vectors
+_Static_assert(sizeof(struct Board) == 8 && offsetof(struct Board, pieces) == 4, "the pieces are the last 4 bytes of a board");
+
+static const int8x16 EVEN_BYTES = { 0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30 };
+
+// Weight of a line with one piece and with two pieces of a player, per lane
+// once the byte lanes are widened to 16 bits: lanes 0 to 8 are the boards,
+// lane 9 the boards as one group.
+static const int16x8 ONE_PIECE_WEIGHTS_LOW = { 10, 10, 10, 10, 10, 10, 10, 10 };
+static const int16x8 ONE_PIECE_WEIGHTS_HIGH = { 10, 100, 0, 0, 0, 0, 0, 0 };
+static const int16x8 TWO_PIECES_WEIGHTS_LOW = { 100, 100, 100, 100, 100, 100, 100, 100 };
+static const int16x8 TWO_PIECES_WEIGHTS_HIGH = { 100, 1000, 0, 0, 0, 0, 0, 0 };
+
+SIMD_TARGET static inline int8x16 get_cells(int8x16 player1Bits, int8x16 player2Bits, int8_t bit)
+{
+	// One cell of every board, 1 for a piece of player 1 and 4 for one of
+	// player 2, with byte compares (pcmpeqb) that give -1 where the bit is set
+	int8x16 mask = (int8x16){ 0 } + bit;
+	return (((player1Bits & mask) == mask) & 1) | (((player2Bits & mask) == mask) & 4);
+}
+SIMD_TARGET static inline void count_line(int8x16 a, int8x16 b, int8x16 c, int8x16* onePieceLines, int8x16* twoPiecesLines)
+{
+	// The pieces of a line add up to 1 or 2 when only player 1 has pieces on
+	// it and to 4 or 8 when only player 2 has, anything else scores nothing.
+	// The counts are for player 1, minus the lines of player 2.
+	int8x16 sum = a + b + c;
+	*onePieceLines += (sum == 4) - (sum == 1);
+	*twoPiecesLines += (sum == 8) - (sum == 2);
+}
+SIMD_TARGET static inline int16x8 widen_low(int8x16 value)
+{
+	// Interleaves the low 8 bytes with their sign (punpcklbw)
+	return (int16x8)__builtin_shuffle(value, value < 0, (int8x16){ 0, 16, 1, 17, 2, 18, 3, 19, 4, 20, 5, 21, 6, 22, 7, 23 });
+}
+SIMD_TARGET static inline int16x8 widen_high(int8x16 value)
+{
+	return (int16x8)__builtin_shuffle(value, value < 0, (int8x16){ 8, 24, 9, 25, 10, 26, 11, 27, 12, 28, 13, 29, 14, 30, 15, 31 });
+}
+SIMD_TARGET int evaluate_game_simd(struct Game* game)
+{
+	// Score for player 1. Byte lane n of the vectors is board n and lane 9
+	// the won boards as one group, so all the boards and the group are scored
+	// at once. Won boards are left empty and scored on their own, drawn
+	// boards still score their lines like in the tables.
+	//
+	// Boards 0 to 7 are loaded two at a time, the pieces of a board are its
+	// last 32 bits (shufps).
+	int32x4 boardPieces0 = __builtin_shuffle(*(unaligned_int32x4*)&game->boards[0], *(unaligned_int32x4*)&game->boards[2], (int32x4){ 1, 3, 5, 7 });
+	int32x4 boardPieces4 = __builtin_shuffle(*(unaligned_int32x4*)&game->boards[4], *(unaligned_int32x4*)&game->boards[6], (int32x4){ 1, 3, 5, 7 });
+	int32x4 wonLanes = (int32x4){ 0 } + (game->wonBoards[0] | game->wonBoards[1]);
+	boardPieces0 &= (wonLanes & (int32x4){ 0x01, 0x02, 0x04, 0x08 }) == 0;
+	boardPieces4 &= (wonLanes & (int32x4){ 0x10, 0x20, 0x40, 0x80 }) == 0;
+
+	// Board 8 and the group, and the 16 bit masks of every lane for both
+	// players
+	uint16_t lastBoardMask = (wonLanes[0] & (1 << 8)) ? 0 : FULL_BOARD_MASK;
+	int16x8 player1High = { game->boards[8].pieces[0] & lastBoardMask, useMacroEval ? game->wonBoards[0] : 0 };
+	int16x8 player2High = { game->boards[8].pieces[1] & lastBoardMask, useMacroEval ? game->wonBoards[1] : 0 };
+	int16x8 player1Low = __builtin_shuffle((int16x8)boardPieces0, (int16x8)boardPieces4, (int16x8){ 0, 2, 4, 6, 8, 10, 12, 14 });
+	int16x8 player2Low = __builtin_shuffle((int16x8)boardPieces0, (int16x8)boardPieces4, (int16x8){ 1, 3, 5, 7, 9, 11, 13, 15 });
+
+	// The low 8 bits of every lane of both players and the last bits of both
+	// in bytes (packuswb)
+	int8x16 player1Bits = __builtin_shuffle((int8x16)player1Low, (int8x16)player1High, EVEN_BYTES);
+	int8x16 player2Bits = __builtin_shuffle((int8x16)player2Low, (int8x16)player2High, EVEN_BYTES);
+	int8x16 lastBits = __builtin_shuffle((int8x16)((player1Low >> 8) | (player2Low >> 7 & 2)), (int8x16)((player1High >> 8) | (player2High >> 7 & 2)), EVEN_BYTES);
+
+	// The 81 cells of the boards and the 9 of the group in 9 vectors
+	int8x16 cell0 = get_cells(player1Bits, player2Bits, 0x01);
+	int8x16 cell1 = get_cells(player1Bits, player2Bits, 0x02);
+	int8x16 cell2 = get_cells(player1Bits, player2Bits, 0x04);
+	int8x16 cell3 = get_cells(player1Bits, player2Bits, 0x08);
+	int8x16 cell4 = get_cells(player1Bits, player2Bits, 0x10);
+	int8x16 cell5 = get_cells(player1Bits, player2Bits, 0x20);
+	int8x16 cell6 = get_cells(player1Bits, player2Bits, 0x40);
+	int8x16 cell7 = get_cells(player1Bits, player2Bits, (int8_t)0x80);
+	int8x16 cell8 = get_cells(lastBits, lastBits >> 1, 0x01);
+
+	// The lines of SCORE_LINE_MASKS in gen_tables.c: the columns, the rows
+	// and the top-left to bottom-right diagonal twice. Every lane counts at
+	// most 8 lines each way.
+	int8x16 onePieceLines = { 0 };
+	int8x16 twoPiecesLines = { 0 };
+	count_line(cell0, cell3, cell6, &onePieceLines, &twoPiecesLines);
+	count_line(cell1, cell4, cell7, &onePieceLines, &twoPiecesLines);
+	count_line(cell2, cell5, cell8, &onePieceLines, &twoPiecesLines);
+	count_line(cell0, cell1, cell2, &onePieceLines, &twoPiecesLines);
+	count_line(cell3, cell4, cell5, &onePieceLines, &twoPiecesLines);
+	count_line(cell6, cell7, cell8, &onePieceLines, &twoPiecesLines);
+	count_line(cell0, cell4, cell8, &onePieceLines, &twoPiecesLines);
+	count_line(cell0, cell4, cell8, &onePieceLines, &twoPiecesLines);
+
+	// Weigh the lanes in 16 bits and add them up, at most 9 * 800 + 8000
+	int16x8 lineScores = widen_low(onePieceLines) * ONE_PIECE_WEIGHTS_LOW + widen_high(onePieceLines) * ONE_PIECE_WEIGHTS_HIGH
+		+ widen_low(twoPiecesLines) * TWO_PIECES_WEIGHTS_LOW + widen_high(twoPiecesLines) * TWO_PIECES_WEIGHTS_HIGH;
+	lineScores += __builtin_shuffle(lineScores, (int16x8){ 4, 5, 6, 7, 0, 1, 2, 3 });
+	lineScores += __builtin_shuffle(lineScores, (int16x8){ 2, 3, 0, 1, 6, 7, 4, 5 });
+	lineScores += __builtin_shuffle(lineScores, (int16x8){ 1, 0, 3, 2, 5, 4, 7, 6 });
+
+	// A won board is worth 1000 whatever its pieces
+	return 1000 * (__builtin_popcount(game->wonBoards[0]) - __builtin_popcount(game->wonBoards[1])) + lineScores[0];
+}
+
+// Scores a game that hasn't ended yet
+int evaluate_open_game(struct Game* game, enum board_piece playerToEvaluate)
+{
+	int score;
+	if(useSimdEval)
+		score = evaluate_game_simd(game);
+	else
+	{
+		// do_move and undo_move keep the score of every board and of the
+		// boards as one group up to date, it's stored for player 1.
+		score = game->evalScore;
+		if(!useMacroEval)
+			score -= macro_score_table[game->macroPattern];
+	}
+	return playerToEvaluate == PLAYER1 ? score : -score;
+}
+int evaluate_game_for_player(struct Game* game, enum board_piece playerToEvaluate)
+{
+	enum board_state winningPlayer = get_winning_player(game);
+	if(winningPlayer == get_winning_state(playerToEvaluate))
+		return WIN_SCORE;
+	else if(winningPlayer == DRAW)
+		return 0;
+	else if(winningPlayer != UNDECIDED)
+		return -WIN_SCORE;
+
+	return evaluate_open_game(game, playerToEvaluate);
+}
+
+enum tt_bound
+{
+	TT_EXACT = 0,
+	TT_LOWER = 1,	// The real score is at least the stored score
+	TT_UPPER = 2	// The real score is at most the stored score
+};
+struct TTEntry
+{
+	uint32_t check;		// Upper 32 bits of the position hash xor'ed with the data below
+	int32_t score;		// Score for the player to move in the position
+	uint8_t depth;
+	uint8_t bound;
+	uint8_t bestMove;	// Cell of the best move (see get_move_cell), 0xFF if unknown
+	uint8_t age;
+};
+
+#define TT_BUCKET_SIZE 4
+#define TT_MIN_BUCKET_COUNT 1024
+
+// Transposition table, every position hashes to one bucket of entries. The
+// number of buckets is a power of two that depends on the memory the
+// platform gives it, see tt_set_memory.
+//
+// The table is shared by all CPUs without locking. Two CPUs writing the same
+// entry at once could leave it half of one and half of the other, so the key
+// is stored xor'ed with the rest of the entry. A mixed up entry then no
+// longer matches its key and is ignored.
+struct TTEntry (*transposition_table)[TT_BUCKET_SIZE];
+uint32_t ttBucketCount = 0;
+size_t ttMemorySize = 0;	// The memory given to tt_set_memory, the table may use less
+uint8_t ttAge = 0;
+
+// Move ordering: moves that caused a beta cutoff are remembered per ply as
+// killer moves, and per player and cell in the history table. Moves are
+// searched best scored first so cutoffs happen as early as possible.
+uint8_t useMoveOrdering = 1;
+
+// Principal variation search: only the first move of a node is searched with
+// the full window. The others are searched with a null window around alpha,
+// which only tells if they are better, and again with the full window when
+// they are. The root starts every iteration with a narrow aspiration window,
+// see search_game. Without it every move gets the full window.
+uint8_t usePvs = 1;
+
+// Beyond any score, the window of a search that knows nothing yet
+#define INFINITE_SCORE 1000000000
+// Half the width of the first aspiration window, it grows this many times
+// over every time the score falls outside.
+#define ASPIRATION_WINDOW 25
+#define ASPIRATION_GROWTH 4
+
+static inline void cpu_relax()
+{
+#if defined(__i386__) || defined(__x86_64__)
+	asm volatile ( "pause" );
+#endif
+}
+static inline void spin_lock(volatile uint32_t* lock)
+{
+	while(__sync_lock_test_and_set(lock, 1))
+	{
+		while(*lock)
+			cpu_relax();
+	}
+}
+static inline void spin_unlock(volatile uint32_t* lock)
+{
+	__sync_lock_release(lock);
+}
+
+// Young Brothers Wait: once the first move of a node has been searched
+// without a cutoff, the remaining moves (the younger brothers) may be
+// searched in parallel. The node then becomes a split point and every
+// remaining move becomes a task that idle CPUs can steal. The CPU that owns
+// the split point searches its own tasks too and waits until all are done.
+#define SPLIT_MIN_DEPTH 3
+#define TASK_DEQUE_SIZE 1024
+
+struct SplitPoint
+{
+	// The split point the owner was searching under, a cutoff there also
+	// stops all searches of this split point.
+	struct SplitPoint* parent;
+
+	struct Game game;	// The position at the split point, copied by the helpers
+	struct MoveList* moveList;	// Sorted, the owner doesn't touch it during the split
+	int depth;
+	int ply;
+
+	// Shared search state, only updated while holding the lock
+	volatile uint32_t lock;
+	volatile int alpha;
+	volatile int beta;
+	volatile int bestScore;
+	volatile uint8_t bestMove;
+	volatile uint8_t cutoff;
+	volatile uint8_t cutoffMove;
+
+	volatile uint32_t pendingTasks;
+};
+struct SplitTask
+{
+	struct SplitPoint* splitPoint;
+	unsigned int moveIndex;
+};
+// Tasks of the split points of one CPU. The owner pushes and pops tasks at
+// the bottom, idle CPUs steal the oldest tasks from the top.
+struct TaskDeque
+{
+	struct SplitTask tasks[TASK_DEQUE_SIZE];
+	volatile uint32_t top;
+	volatile uint32_t bottom;
+	volatile uint32_t lock;
+};
+
+// Everything one thread needs to search on its own: its own copy of the game,
+// a move list per ply, move ordering tables and statistics.
+struct SearchContext
+{
+	struct Game game;
+	struct MoveList moveLists[MAX_SEARCH_PLY];
+
+	uint8_t killerMoves[MAX_SEARCH_PLY][2];
+	uint32_t historyScores[2][81];
+	int moveOrderScores[MAX_SEARCH_PLY][81];
+
+	// The split point this CPU is currently searching a task of, if any
+	struct SplitPoint* splitPoint;
+	struct SplitPoint splitPoints[MAX_SEARCH_PLY];
+	struct TaskDeque tasks;
+
+	// Only one CPU checks the time, it stops the search of the others when time is up
+	uint8_t checksTime;
+
+	unsigned int totalCalls;
+	unsigned int splitCount;
+	unsigned int ttProbes;
+	unsigned int ttHits;
+	unsigned int ttCutoffs;
+	unsigned int expandedNodes;
+	unsigned int movesSearched;
+	unsigned int betaCutoffs;
+	unsigned int firstMoveCutoffs;
+};
+
+uint32_t tt_entry_data(struct TTEntry* entry)
+{
+	return (uint32_t)entry->score ^ (entry->depth | entry->bound << 8 | entry->bestMove << 16 | entry->age << 24);
+}
+int tt_probe(struct SearchContext* context, uint64_t hash, struct TTEntry* result)
+{
+	struct TTEntry* bucket = transposition_table[(uint32_t)hash & (ttBucketCount - 1)];
+	uint32_t key = (uint32_t)(hash >> 32);
+
+	context->ttProbes++;
+	for(int i = 0; i < TT_BUCKET_SIZE; i++)
+	{
+		// Copy the entry first, another CPU might be writing to it
+		*result = bucket[i];
+		if(result->depth > 0 && (result->check ^ tt_entry_data(result)) == key)
+		{
+			context->ttHits++;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+void tt_store(uint64_t hash, int depth, enum tt_bound bound, int score, uint8_t bestMove)
+{
+	struct TTEntry* bucket = transposition_table[(uint32_t)hash & (ttBucketCount - 1)];
+	uint32_t key = (uint32_t)(hash >> 32);
+
+	// Overwrite the entry of the same position if there is one. Otherwise
+	// replace the entry that is least useful: one left over from an earlier
+	// search or else the one searched to the lowest depth.
+	struct TTEntry* replace = &bucket[0];
+	for(int i = 0; i < TT_BUCKET_SIZE; i++)
+	{
+		struct TTEntry* entry = &bucket[i];
+		if((entry->check ^ tt_entry_data(entry)) == key)
+		{
+			replace = entry;
+			break;
+		}
+
+		int entryIsOld = entry->age != ttAge;
+		int replaceIsOld = replace->age != ttAge;
+		if(entryIsOld > replaceIsOld || (entryIsOld == replaceIsOld && entry->depth < replace->depth))
+			replace = entry;
+	}
+
+	struct TTEntry entry;
+	entry.score = score;
+	entry.depth = depth;
+	entry.bound = bound;
+	entry.bestMove = bestMove;
+	entry.age = ttAge;
+	entry.check = key ^ tt_entry_data(&entry);
+	*replace = entry;
+}
+void put_move_first(struct MoveList* moveList, uint8_t cell)
+{
+	// Swap the move for the given cell to the front so it gets searched first
+	for(unsigned int i = 0; i < moveList->count; i++)
+	{
+		struct Move* move = &moveList->moves[i];
+		if(get_move_cell(move) != cell)
+			continue;
+
+		if(i > 0)
+		{
+			struct Move* firstMove = &moveList->moves[0];
+			struct Move tmp = *firstMove;
+			*firstMove = *move;
+			*move = tmp;
+		}
+		return;
+	}
+}
+
+void reset_move_ordering(struct SearchContext* context)
+{
+	for(int ply = 0; ply < MAX_SEARCH_PLY; ply++)
+	{
+		context->killerMoves[ply][0] = 0xFF;
+		context->killerMoves[ply][1] = 0xFF;
+	}
+
+	// Keep the history of earlier searches but let new cutoffs count for more
+	for(int player = 0; player < 2; player++)
+	{
+		for(int cell = 0; cell < 81; cell++)
+			context->historyScores[player][cell] >>= 1;
+	}
+}
+void score_moves(struct SearchContext* context, struct MoveList* moveList, int ply, uint8_t ttMove)
+{
+	int* scores = context->moveOrderScores[ply];
+
+	for(unsigned int i = 0; i < moveList->count; i++)
+	{
+		struct Move* move = &moveList->moves[i];
+		uint8_t cell = get_move_cell(move);
+
+		// History scores are kept well below the scores of the special moves
+		if(cell == ttMove)
+			scores[i] = 0x7FFFFFFF;
+		else if(cell == context->killerMoves[ply][0])
+			scores[i] = 0x7FFFFFFE;
+		else if(cell == context->killerMoves[ply][1])
+			scores[i] = 0x7FFFFFFD;
+		else
+			scores[i] = context->historyScores[move->piece - 1][cell];
+	}
+}
+void select_next_move(struct SearchContext* context, struct MoveList* moveList, int ply, unsigned int index)
+{
+	// Selection sort one step at a time: swap the best scored of the remaining
+	// moves to the given index. Most nodes cut off after a few moves, so
+	// there's no point in sorting the whole list up front.
+	int* scores = context->moveOrderScores[ply];
+
+	unsigned int bestIndex = index;
+	for(unsigned int i = index + 1; i < moveList->count; i++)
+	{
+		if(scores[i] > scores[bestIndex])
+			bestIndex = i;
+	}
+
+	if(bestIndex != index)
+	{
+		struct Move* move = &moveList->moves[index];
+		struct Move* bestMove = &moveList->moves[bestIndex];
+
+		struct Move tmpMove = *move;
+		*move = *bestMove;
+		*bestMove = tmpMove;
+
+		int tmpScore = scores[index];
+		scores[index] = scores[bestIndex];
+		scores[bestIndex] = tmpScore;
+	}
+}
+void record_cutoff_move(struct SearchContext* context, struct Move* move, int ply, int depth)
+{
+	uint8_t cell = get_move_cell(move);
+
+	if(context->killerMoves[ply][0] != cell)
+	{
+		context->killerMoves[ply][1] = context->killerMoves[ply][0];
+		context->killerMoves[ply][0] = cell;
+	}
+
+	context->historyScores[move->piece - 1][cell] += depth * depth;
+}
+
+unsigned int totalCalls = 0;
+
+// Time control of the running search
+uint32_t searchStartMs;
+uint32_t searchTimeMs;
+uint32_t searchElapsedMs;	// Time the last search took
+unsigned int searchNodeLimit = 0;
+volatile uint8_t searchAborted;
+int searchDepthReached;
+uint8_t searchSolved;		// The last search was answered by the solver
+unsigned int searchPlayouts;	// Playouts of the last search if it was a Monte Carlo search
+
+// Thread 0 runs search_game, the others help out with the split points
+struct SearchContext searchContexts[MAX_SEARCH_THREADS];
+size_t searchThreadCount = 1;
+volatile uint8_t searchRunning = 0;
+
+int push_split_tasks(struct SearchContext* context, struct SplitPoint* splitPoint, unsigned int firstIndex)
+{
+	struct TaskDeque* deque = &context->tasks;
+
+	spin_lock(&deque->lock);
+	unsigned int taskCount = splitPoint->moveList->count - firstIndex;
+	if(deque->bottom + taskCount > TASK_DEQUE_SIZE)
+	{
+		spin_unlock(&deque->lock);
+		return 0;
+	}
+
+	// Push the best ordered moves last, the owner pops those first
+	for(unsigned int i = splitPoint->moveList->count; i > firstIndex; i--)
+	{
+		struct SplitTask* task = &deque->tasks[deque->bottom++];
+		task->splitPoint = splitPoint;
+		task->moveIndex = i - 1;
+	}
+	spin_unlock(&deque->lock);
+
+	return 1;
+}
+int pop_split_task(struct SearchContext* context, struct SplitPoint* splitPoint, struct SplitTask* result)
+{
+	struct TaskDeque* deque = &context->tasks;
+	int found = 0;
+
+	// Only take tasks of the given split point, the tasks below it belong to
+	// split points further up the tree that are still waiting on this one.
+	spin_lock(&deque->lock);
+	if(deque->bottom > deque->top && deque->tasks[deque->bottom - 1].splitPoint == splitPoint)
+	{
+		*result = deque->tasks[--deque->bottom];
+		found = 1;
+	}
+	if(deque->bottom == deque->top)
+	{
+		deque->top = 0;
+		deque->bottom = 0;
+	}
+	spin_unlock(&deque->lock);
+
+	return found;
+}
+int steal_split_task(size_t threadIndex, struct SplitTask* result)
+{
+	for(size_t i = 1; i < searchThreadCount; i++)
+	{
+		struct TaskDeque* deque = &searchContexts[(threadIndex + i) % searchThreadCount].tasks;
+		if(deque->bottom == deque->top)
+			continue;
+
+		int found = 0;
+		spin_lock(&deque->lock);
+		if(deque->bottom > deque->top)
+		{
+			*result = deque->tasks[deque->top++];
+			found = 1;
+		}
+		if(deque->bottom == deque->top)
+		{
+			deque->top = 0;
+			deque->bottom = 0;
+		}
+		spin_unlock(&deque->lock);
+
+		if(found)
+			return 1;
+	}
+
+	return 0;
+}
+
+int search_is_aborted(struct SearchContext* context)
+{
+	if(searchAborted)
+		return 1;
+
+	// A cutoff at any split point we are searching under makes the rest of
+	// the search there useless.
+	for(struct SplitPoint* splitPoint = context->splitPoint; splitPoint; splitPoint = splitPoint->parent)
+	{
+		if(splitPoint->cutoff)
+			return 1;
+	}
+
+	return 0;
+}
+
+int do_negamax(struct SearchContext* context, struct Game* game, int depth, int ply, int alpha, int beta);
+
+int search_time_is_up()
+{
+	if(timer_get_ms() - searchStartMs >= searchTimeMs)
+		return 1;
+
+	if(searchNodeLimit)
+	{
+		unsigned int nodes = 0;
+		for(size_t i = 0; i < searchThreadCount; i++)
+			nodes += searchContexts[i].totalCalls;
+		if(nodes >= searchNodeLimit)
+			return 1;
+	}
+
+	// The platform may want the search to stop early, for instance when
+	// pondering and a key comes in
+	return search_poll_stop();
+}
+
+void update_split_point(struct SplitPoint* splitPoint, struct Move* move, int score)
+{
+	spin_lock(&splitPoint->lock);
+	if(score > splitPoint->bestScore)
+	{
+		splitPoint->bestScore = score;
+		splitPoint->bestMove = get_move_cell(move);
+	}
+	if(score > splitPoint->alpha)
+		splitPoint->alpha = score;
+
+	if(splitPoint->alpha >= splitPoint->beta && !splitPoint->cutoff)
+	{
+		splitPoint->cutoffMove = get_move_cell(move);
+		splitPoint->cutoff = 1;
+	}
+	spin_unlock(&splitPoint->lock);
+}
+// Searches one move of a node and returns its score for the player to move
+// at the node. See usePvs for how the moves after the first are searched.
+int search_move(struct SearchContext* context, struct Game* game, struct Move* move, int depth, int ply, int alpha, int beta, int isFirstMove)
+{
+	context->movesSearched++;
+
+	// Search the move in place, undo_move restores the game afterwards
+	do_move(game, move);
+	int score;
+	if(isFirstMove || !usePvs)
+		score = -do_negamax(context, game, depth - 1, ply + 1, -beta, -alpha);
+	else
+	{
+		score = -do_negamax(context, game, depth - 1, ply + 1, -alpha - 1, -alpha);
+		if(score > alpha && score < beta)
+			score = -do_negamax(context, game, depth - 1, ply + 1, -beta, -alpha);
+	}
+	undo_move(game, move);
+
+	return score;
+}
+void execute_split_task(struct SearchContext* context, struct SplitTask* task, struct Game* ownerGame)
+{
+	struct SplitPoint* splitPoint = task->splitPoint;
+	struct SplitPoint* previousSplitPoint = context->splitPoint;
+	context->splitPoint = splitPoint;
+
+	if(!search_is_aborted(context))
+	{
+		// The owner searches on its own game, which is still at the split
+		// point. Helpers search on a copy.
+		struct Game* game = ownerGame;
+		if(!game)
+		{
+			context->game = splitPoint->game;
+			game = &context->game;
+		}
+
+		// Never the first move, that one is searched before the split
+		struct Move move = splitPoint->moveList->moves[task->moveIndex];
+		int score = search_move(context, game, &move, splitPoint->depth, splitPoint->ply, splitPoint->alpha, splitPoint->beta, 0);
+
+		if(!search_is_aborted(context))
+			update_split_point(splitPoint, &move, score);
+	}
+
+	context->splitPoint = previousSplitPoint;
+	__sync_fetch_and_sub(&splitPoint->pendingTasks, 1);
+}
+
+// Searches the moves of a node and returns the best score, the cell of the
+// best move is stored in bestMoveResult. The first move is searched here,
+// after that the remaining moves may be split among the CPUs.
+int search_moves(struct SearchContext* context, struct Game* game, struct MoveList* moveList, int depth, int ply, int alpha, int beta, uint8_t* bestMoveResult)
+{
+	int bestScore = -INFINITE_SCORE;
+	uint8_t bestMove = 0xFF;
+
+	context->expandedNodes++;
+	for(unsigned int i = 0; i < moveList->count; i++)
+	{
+		if(useMoveOrdering)
+			select_next_move(context, moveList, ply, i);
+
+		struct Move* move = &moveList->moves[i];
+		int score = search_move(context, game, move, depth, ply, alpha, beta, i == 0);
+
+		if(search_is_aborted(context))
+			return 0;
+
+		if(score > bestScore)
+		{
+			bestScore = score;
+			bestMove = get_move_cell(move);
+		}
+		if(score > alpha)
+			alpha = score;
+
+		// The opponent won't allow this node, it's better for us than the
+		// best they have elsewhere
+		if(alpha >= beta)
+		{
+			// With good move ordering most cutoffs come from the first move
+			context->betaCutoffs++;
+			if(i == 0)
+				context->firstMoveCutoffs++;
+
+			if(useMoveOrdering)
+				record_cutoff_move(context, move, ply, depth);
+			break;
+		}
+
+		// The eldest brother has been searched, see if the younger brothers
+		// are worth splitting among the other CPUs.
+		if(i == 0 && searchThreadCount > 1 && depth >= SPLIT_MIN_DEPTH && moveList->count > 2)
+		{
+			// Helpers search the moves in list order, so finish sorting first
+			if(useMoveOrdering)
+			{
+				for(unsigned int j = 1; j < moveList->count; j++)
+					select_next_move(context, moveList, ply, j);
+			}
+
+			struct SplitPoint* splitPoint = &context->splitPoints[ply];
+			splitPoint->parent = context->splitPoint;
+			splitPoint->game = *game;
+			splitPoint->moveList = moveList;
+			splitPoint->depth = depth;
+			splitPoint->ply = ply;
+			splitPoint->lock = 0;
+			splitPoint->alpha = alpha;
+			splitPoint->beta = beta;
+			splitPoint->bestScore = bestScore;
+			splitPoint->bestMove = bestMove;
+			splitPoint->cutoff = 0;
+			splitPoint->cutoffMove = 0xFF;
+			splitPoint->pendingTasks = moveList->count - 1;
+
+			if(!push_split_tasks(context, splitPoint, 1))
+				continue;
+
+			context->splitCount++;
+
+			// Search our own tasks until the rest has been stolen, then wait
+			// for the helpers to finish theirs.
+			struct SplitTask task;
+			while(pop_split_task(context, splitPoint, &task))
+				execute_split_task(context, &task, game);
+
+			while(splitPoint->pendingTasks > 0)
+			{
+				if(context->checksTime && search_time_is_up())
+					searchAborted = 1;
+				cpu_relax();
+			}
+
+			if(search_is_aborted(context))
+				return 0;
+
+			if(splitPoint->cutoff)
+				context->betaCutoffs++;
+			if(splitPoint->cutoff && useMoveOrdering)
+			{
+				struct Move cutoffMove;
+				get_move_from_cell(&cutoffMove, splitPoint->cutoffMove, game->curPlayer);
+				record_cutoff_move(context, &cutoffMove, ply, depth);
+			}
+
+			bestScore = splitPoint->bestScore;
+			bestMove = splitPoint->bestMove;
+			break;
+		}
+	}
+
+	*bestMoveResult = bestMove;
+	return bestScore;
+}
+
+// Wins and losses are scored by their distance from the root, see
+// WIN_SCORE. The transposition table is shared by searches from other roots,
+// so it stores them by their distance from the stored position.
+int score_to_tt(int score, int ply)
+{
+	if(score >= WIN_SCORE_MIN)
+		return score + ply;
+	if(score <= -WIN_SCORE_MIN)
+		return score - ply;
+	return score;
+}
+int score_from_tt(int score, int ply)
+{
+	if(score >= WIN_SCORE_MIN)
+		return score - ply;
+	if(score <= -WIN_SCORE_MIN)
+		return score + ply;
+	return score;
+}
+
+// Negamax: returns the score of the game for the player to move, between
+// alpha and beta. A score at or below alpha is only an upper bound of the
+// real score, a score at or above beta a lower bound.
+int do_negamax(struct SearchContext* context, struct Game* game, int depth, int ply, int alpha, int beta)
+{
+	context->totalCalls++;
+
+	// Check the clock every so many nodes, once the time for this move is up
+	// every search returns right away and the result is thrown away.
+	if(context->checksTime && (context->totalCalls & 1023) == 0 && search_time_is_up())
+		searchAborted = 1;
+	if(search_is_aborted(context))
+		return 0;
+
+	enum board_state winningPlayer = get_winning_player(game);
+	if(winningPlayer == DRAW)
+		return 0;
+	else if(winningPlayer != UNDECIDED)
+		return winningPlayer == game->curPlayer ? WIN_SCORE - ply : -WIN_SCORE + ply;
+
+	if(depth == 0)
+	{
+		// Max depth reached, return the score for the player to move
+		return evaluate_open_game(game, game->curPlayer);
+	}
+
+	// Nothing from here on wins sooner than the next ply, or loses sooner
+	// than the ply after. When a shorter win is already known elsewhere
+	// there's nothing to search.
+	if(alpha < -WIN_SCORE + ply + 2)
+		alpha = -WIN_SCORE + ply + 2;
+	if(beta > WIN_SCORE - ply - 1)
+		beta = WIN_SCORE - ply - 1;
+	if(alpha >= beta)
+		return alpha;
+
+	uint8_t ttMove = 0xFF;
+	struct TTEntry entry;
+	if(tt_probe(context, game->hash, &entry))
+	{
+		ttMove = entry.bestMove;
+
+		if(entry.depth >= depth)
+		{
+			int score = score_from_tt(entry.score, ply);
+			if(entry.bound == TT_EXACT ||
+			   (entry.bound == TT_LOWER && score >= beta) ||
+			   (entry.bound == TT_UPPER && score <= alpha))
+			{
+				context->ttCutoffs++;
+				return score;
+			}
+		}
+	}
+
+	// This is not the last depth, generate a new set of moves
+	struct MoveList* moveList = &context->moveLists[ply];
+	put_moves_for_game(game, moveList);
+	if(moveList->count == 0)
+	{
+		return evaluate_game_for_player(game, game->curPlayer);
+	}
+
+	// Search the best move of an earlier search of this position first,
+	// followed by the killer moves and the moves with the best history.
+	if(useMoveOrdering)
+		score_moves(context, moveList, ply, ttMove);
+	else if(ttMove != 0xFF)
+		put_move_first(moveList, ttMove);
+
+	uint8_t bestMove;
+	int bestScore = search_moves(context, game, moveList, depth, ply, alpha, beta, &bestMove);
+
+	if(search_is_aborted(context))
+		return 0;
+
+	enum tt_bound bound = TT_EXACT;
+	if(bestScore <= alpha)
+		bound = TT_UPPER;
+	else if(bestScore >= beta)
+		bound = TT_LOWER;
+	tt_store(game->hash, depth, bound, score_to_tt(bestScore, ply), bestMove);
+
+	return bestScore;
+}
+
+// Searches the given game and returns the cell of the best move for the
+// player to move. Searches deeper and deeper until maxDepth is reached or
+// timeMs milliseconds have passed.
+uint8_t search_game(struct Game* searchGame, size_t maxDepth, uint32_t timeMs, int* scoreResult)
+{
+	struct SearchContext* context = &searchContexts[0];
+
+	ttAge++;
+	searchStartMs = timer_get_ms();
+	searchTimeMs = timeMs;
+	searchAborted = 0;
+	searchDepthReached = 0;
+	searchSolved = 0;
+	searchPlayouts = 0;
+
+	for(size_t i = 0; i < searchThreadCount; i++)
+	{
+		struct SearchContext* cpuContext = &searchContexts[i];
+		cpuContext->splitPoint = 0;
+		cpuContext->totalCalls = 0;
+		cpuContext->splitCount = 0;
+		cpuContext->ttProbes = 0;
+		cpuContext->ttHits = 0;
+		cpuContext->ttCutoffs = 0;
+		cpuContext->expandedNodes = 0;
+		cpuContext->movesSearched = 0;
+		cpuContext->betaCutoffs = 0;
+		cpuContext->firstMoveCutoffs = 0;
+		reset_move_ordering(cpuContext);
+	}
+
+	// The search works on a copy, the other CPUs may still look at it while
+	// they finish up after the time has run out.
+	context->game = *searchGame;
+	struct Game* rootGame = &context->game;
+
+	// Generate the first set of moves. They stay in the ply 0 move list of
+	// CPU 0 for the whole search.
+	struct MoveList* moveList = &context->moveLists[0];
+	put_moves_for_game(rootGame, moveList);
+
+	// A game that is over has no move, only its result
+	if(moveList->count == 0 || get_winning_player(rootGame) != UNDECIDED)
+	{
+		searchElapsedMs = 0;
+		totalCalls = 0;
+		*scoreResult = evaluate_game_for_player(rootGame, rootGame->curPlayer);
+		return 0xFF;
+	}
+
+	// Fall back to the first move in case not even the first iteration
+	// finishes. Start with the best move of an earlier search if there is one.
+	int maxScore = 0;
+	int previousScore = 0;
+	uint8_t maxScoreCell = get_move_cell(&moveList->moves[0]);
+
+	struct TTEntry entry;
+	if(tt_probe(context, rootGame->hash, &entry) && entry.bestMove != 0xFF)
+		maxScoreCell = entry.bestMove;
+
+	// Close to the end of the game the solver can tell the exact result.
+	// The score of a win goes down with the plies it takes, so the quickest
+	// win and the slowest loss score best.
+	struct SolverResult solved;
+	if(useSolver && solver_can_solve(rootGame) && solver_solve(rootGame, &solved, search_time_is_up, &context->totalCalls))
+	{
+		searchSolved = 1;
+		searchDepthReached = solved.distance;
+		maxScoreCell = solved.cell;
+		maxScore = solved.value == SOLVER_WIN ? WIN_SCORE - solved.distance : solved.value == SOLVER_LOSS ? -WIN_SCORE + solved.distance : 0;
+	}
+
+	// The Monte Carlo search takes the place of the alpha-beta search, on
+	// this CPU only. Without a time or node limit it stops once its tree
+	// is full.
+	int searchedByMcts = 0;
+	if(useMcts && !searchSolved && moveList->count > 1 && mcts_memory_size() > 0)
+	{
+		struct MctsResult mcts;
+		searchAborted = mcts_search(rootGame, &mcts, search_time_is_up, timeMs == 0xFFFFFFFF && !searchNodeLimit, &context->totalCalls);
+		searchedByMcts = 1;
+		searchPlayouts = mcts.playouts;
+		searchDepthReached = mcts.depth;
+		maxScoreCell = mcts.cell;
+		maxScore = mcts.score;
+	}
+
+	// Let the other CPUs look for tasks to steal
+	searchRunning = 1;
+
+	// Iterative deepening: search one level deeper each iteration until the
+	// time for this move is up. The best move of the last iteration is
+	// searched first, and only the result of a finished iteration is used.
+	for(size_t depth = 1; depth <= maxDepth && moveList->count > 1 && !searchSolved && !searchedByMcts; depth++)
+	{
+		// The score rarely changes much from one iteration to the next, a
+		// window around it cuts off more. The score swings with the player
+		// to move at the leaves, so take the one from two iterations before,
+		// which ended with the same player. There's no telling how far off a
+		// won or lost game is, so those get the full window.
+		int window = ASPIRATION_WINDOW;
+		int alpha = -INFINITE_SCORE;
+		int beta = INFINITE_SCORE;
+		if(usePvs && depth > 2 && previousScore > -WIN_SCORE_MIN && previousScore < WIN_SCORE_MIN)
+		{
+			alpha = previousScore - window;
+			beta = previousScore + window;
+		}
+
+		uint8_t firstCell = maxScoreCell;
+		uint8_t iterationMaxScoreCell;
+		int iterationMaxScore;
+		while(1)
+		{
+			if(useMoveOrdering)
+				score_moves(context, moveList, 0, firstCell);
+			else
+				put_move_first(moveList, firstCell);
+
+			iterationMaxScore = search_moves(context, rootGame, moveList, depth, 0, alpha, beta, &iterationMaxScoreCell);
+			if(searchAborted)
+				break;
+
+			// Outside the window the score is only a bound, search again
+			// with a wider window on that side. Above it the best move is
+			// known to be better than the last one, so that one goes first.
+			window *= ASPIRATION_GROWTH;
+			if(iterationMaxScore <= alpha)
+				alpha = iterationMaxScore > -WIN_SCORE_MIN ? iterationMaxScore - window : -INFINITE_SCORE;
+			else if(iterationMaxScore >= beta)
+			{
+				beta = iterationMaxScore < WIN_SCORE_MIN ? iterationMaxScore + window : INFINITE_SCORE;
+				firstCell = iterationMaxScoreCell;
+			}
+			else
+				break;
+		}
+
+		if(searchAborted)
+			break;
+
+		previousScore = maxScore;
+		maxScore = iterationMaxScore;
+		maxScoreCell = iterationMaxScoreCell;
+		searchDepthReached = depth;
+
+		tt_store(rootGame->hash, depth, TT_EXACT, maxScore, maxScoreCell);
+
+		// No need to look any further once a forced win or loss has been found
+		if(maxScore >= WIN_SCORE_MIN || maxScore <= -WIN_SCORE_MIN)
+			break;
+	}
+
+	searchRunning = 0;
+	searchElapsedMs = timer_get_ms() - searchStartMs;
+
+	totalCalls = 0;
+	for(size_t i = 0; i < searchThreadCount; i++)
+		totalCalls += searchContexts[i].totalCalls;
+
+	*scoreResult = maxScore;
+	return maxScoreCell;
+}
+int search_help(size_t threadIndex)
+{
+	// Steal a task from the split points of the other threads while a
+	// search is running
+	struct SplitTask task;
+	if(!searchRunning || threadIndex >= searchThreadCount || !steal_split_task(threadIndex, &task))
+		return 0;
+
+	execute_split_task(&searchContexts[threadIndex], &task, 0);
+	return 1;
+}
+void search_get_stats(struct SearchStats* stats)
+{
+	stats->depth = searchDepthReached;
+	stats->nodes = totalCalls;
+	stats->splits = 0;
+	stats->ttProbes = 0;
+	stats->ttHits = 0;
+	stats->ttCutoffs = 0;
+	stats->timeMs = searchElapsedMs;
+	stats->solved = searchSolved;
+	stats->playouts = searchPlayouts;
+	stats->expandedNodes = 0;
+	stats->movesSearched = 0;
+	stats->betaCutoffs = 0;
+	stats->firstMoveCutoffs = 0;
+	for(size_t i = 0; i < searchThreadCount; i++)
+	{
+		stats->splits += searchContexts[i].splitCount;
+		stats->ttProbes += searchContexts[i].ttProbes;
+		stats->ttHits += searchContexts[i].ttHits;
+		stats->ttCutoffs += searchContexts[i].ttCutoffs;
+		stats->expandedNodes += searchContexts[i].expandedNodes;
+		stats->movesSearched += searchContexts[i].movesSearched;
+		stats->betaCutoffs += searchContexts[i].betaCutoffs;
+		stats->firstMoveCutoffs += searchContexts[i].firstMoveCutoffs;
+	}
+}
+void search_initialize()
+{
+	init_zobrist_keys();
+
+	// Only thread 0 watches the clock
+	for(size_t i = 0; i < MAX_SEARCH_THREADS; i++)
+		searchContexts[i].checksTime = i == 0;
+}
+
+void tt_clear()
+{
+	// An entry of all zeros is empty
+	__builtin_memset(transposition_table, 0, ttBucketCount * sizeof(*transposition_table));
+
+	// Forget the solved positions too, so a cleared search starts from
+	// nothing, like every move of a match does
+	solver_clear();
+	mcts_clear();
+}
+size_t tt_memory_size(size_t maxSize)
+{
+	size_t bucketCount = TT_MIN_BUCKET_COUNT;
+	while((uint64_t)bucketCount * 2 * sizeof(*transposition_table) <= maxSize)
+		bucketCount *= 2;
+	return bucketCount * sizeof(*transposition_table);
+}
+int tt_set_memory(void* memory, size_t size)
+{
+	if(size < TT_MIN_BUCKET_COUNT * sizeof(*transposition_table))
+		return 0;
+
+	transposition_table = memory;
+	ttMemorySize = size;
+	ttBucketCount = tt_memory_size(size) / sizeof(*transposition_table);
+	tt_clear();
+	return 1;
+}
+size_t tt_limit_size(size_t maxSize)
+{
+	// Uses the front of the table memory only, or all of it for 0. A smaller
+	// table is quicker to clear.
+	if(maxSize == 0 || maxSize > ttMemorySize)
+		maxSize = ttMemorySize;
+
+	ttBucketCount = tt_memory_size(maxSize) / sizeof(*transposition_table);
+	tt_clear();
+	return ttBucketCount * sizeof(*transposition_table);
+}
+uint8_t tt_best_move(uint64_t hash)
+{
+	struct TTEntry entry;
+	if(tt_probe(&searchContexts[0], hash, &entry) && entry.bestMove < 81)
+		return entry.bestMove;
+	return 0xFF;
+}
+
+// The counts were checked against a separate implementation of the rules.
+// The positions cover the start, a move to a board that has been won and
+// one to a board that has been drawn (both allow a move on any board), and
+// a position where games end within the depth.
+const struct PerftPosition perftPositions[] =
+{
+	{ "start", "", 7, 33782544 },
+	{ "sent to won", "12 21 13 31 11", 6, 24811480 },
+	{ "sent to drawn", "35 57 74 41 14 42 24 45 53 37 75 51 12 28 87 72 23 34 47 76 65 59 91 19 93 32 21 13 38 81 18 83 36 64 43 39 97 71 17 73 31 11 16 63 33", 7, 7748259 },
+	{ "game ends", "63 35 52 28 85 58 87 77 75 57 72 26 64 43 38 82 27 73 33 36 62 29 95 54 46 67 78 89 94 49", 8, 38354583 },
+};
+const size_t perftPositionCount = sizeof(perftPositions) / sizeof(perftPositions[0]);
@@ -0,0 +1,198 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* The game engine: the rules of the game and the search. It doesn't depend
+   on anything but the compiler, the kernel and the hosted command line tool
+   both build it. The platform provides the functions at the bottom of this
+   file, the memory for the transposition table, and memcpy and memset, which
+   the compiler calls for struct copies and large clears. */
+
+enum board_state
+{
+	UNDECIDED = 0,
+	PLAYER1_WIN = 1,
+	PLAYER2_WIN = 2,
+	DRAW = 3
+};
+enum board_piece
+{
+	NONE = 0,
+	PLAYER1 = 1,
+	PLAYER2 = 2
+};
+struct Board
+{
+	uint8_t state;
+	// Ternary pattern of the board (see gen_tables.c), used to look up the
+	// state and score of the board.
+	uint16_t pattern;
+	// One 9-bit mask per player (pieces[PLAYER1 - 1] and pieces[PLAYER2 - 1]),
+	// bit n is set when the player owns the piece at index n (y * 3 + x).
+	uint16_t pieces[2];
+};
+struct Move
+{
+	uint8_t prevBoardXIndex;
+	uint8_t prevBoardYIndex;
+	uint8_t boardXIndex;
+	uint8_t boardYIndex;
+	uint8_t pieceXIndex;
+	uint8_t pieceYIndex;
+	uint8_t piece;
+};
+struct Game
+{
+	uint8_t curBoardXIndex;
+	uint8_t curBoardYIndex;
+	uint8_t curPlayer;
+	// Same layout as the board pieces but for the 3x3 grid of boards: bit n is
+	// set when board n has been won by the player or has been decided at all.
+	uint16_t wonBoards[2];
+	uint16_t decidedBoards;
+	// Ternary pattern of the won boards, used to look up the score of the
+	// boards as one group.
+	uint16_t macroPattern;
+	// Evaluation of the position for player 1: the score of every board plus
+	// the score of the boards as one group. Kept up to date by do_move and
+	// undo_move.
+	int32_t evalScore;
+	// Zobrist key of the position, kept up to date by do_move and undo_move.
+	uint64_t hash;
+	struct Board boards[9];
+};
+
+#define FULL_BOARD_MASK 0x1FF
+
+// The moves of one position. There are never more than 81, one per cell.
+#define MAX_MOVES 81
+
+struct MoveList
+{
+	unsigned int count;
+	struct Move moves[MAX_MOVES];
+};
+
+// The search keeps data per ply, so it can't go deeper than this
+#define MAX_SEARCH_PLY 65
+#define MAX_SEARCH_DEPTH (MAX_SEARCH_PLY - 1)
+
+// Scores are for the player to move. A game won n plies from the searched
+// position scores WIN_SCORE - n, a lost one -WIN_SCORE + n, so the quickest
+// win and the slowest loss score best. Scores from WIN_SCORE_MIN up are wins.
+#define WIN_SCORE 1000000
+#define WIN_SCORE_MIN (WIN_SCORE - 100)
+
+// Threads that can take part in a search. Thread 0 calls search_game, the
+// others call search_help while searchRunning is set.
+#define MAX_SEARCH_THREADS 16
+
+struct SearchStats
+{
+	int depth;
+	unsigned int nodes;
+	unsigned int splits;
+	unsigned int ttProbes;
+	unsigned int ttHits;
+	unsigned int ttCutoffs;
+	uint32_t timeMs;
+	// Nodes whose moves were searched, the moves searched at them, and how
+	// many of them stopped early with a beta cutoff, on the first move or
+	// any move.
+	unsigned int expandedNodes;
+	unsigned int movesSearched;
+	unsigned int betaCutoffs;
+	unsigned int firstMoveCutoffs;
+	// The solver gave the exact result, depth is the plies until the game ends
+	uint8_t solved;
+	// Games played out by the Monte Carlo search, 0 for the alpha-beta search
+	unsigned int playouts;
+};
+
+extern uint8_t useMoveOrdering;
+extern uint8_t useMacroEval;
+extern uint8_t useSimdEval;
+extern uint8_t usePvs;
+extern size_t searchThreadCount;	// Threads that take part in a search
+extern volatile uint8_t searchRunning;
+extern volatile uint8_t searchAborted;
+extern int searchDepthReached;
+extern unsigned int totalCalls;
+extern unsigned int searchNodeLimit;	// Stop the search after this many nodes, 0 for no limit
+
+// xorshift32, the state must not be 0
+uint32_t next_random(uint32_t* state);
+uint32_t isqrt(uint64_t x);
+
+void init_zobrist_keys();
+void reset_game(struct Game* game);
+enum board_piece get_board_piece(struct Board* board, uint8_t index);
+void put_moves_for_game(struct Game* game, struct MoveList* moveList);
+enum board_piece get_next_player(enum board_piece player);
+uint8_t get_forced_board_index(struct Game* game);
+uint8_t get_move_cell(struct Move* move);
+void get_move_from_cell(struct Move* move, uint8_t cell, enum board_piece player);
+void play_cell(struct Game* game, uint8_t cell);
+int is_valid_move(struct Game* game, struct Move* move);
+void do_move(struct Game* game, struct Move* move);
+void undo_move(struct Game* game, struct Move* move);
+enum board_state get_winning_player(struct Game* game);
+// PLAYER1_WIN or PLAYER2_WIN for the player
+enum board_state get_winning_state(enum board_piece player);
+int evaluate_game_for_player(struct Game* game, enum board_piece playerToEvaluate);
+// Scores the whole position for player 1 from the pieces with SSE2, gives
+// the same score as evaluate_game_for_player
+int evaluate_game_simd(struct Game* game);
+
+// Moves as text, see cell_to_string. play_moves plays a list of them
+// separated by spaces and returns how many, or -1 at an invalid move.
+void cell_to_string(uint8_t cell, char* result);
+int string_to_cell(const char* text);
+int play_moves(struct Game* game, const char* moves);
+
+// A position as text, see game_from_string. The text takes GAME_STRING_SIZE
+// chars including the terminating 0.
+#define GAME_STRING_SIZE 86
+int game_from_string(struct Game* game, const char* text);
+void game_to_string(struct Game* game, char* result);
+
+uint64_t perft(struct Game* game, int depth);
+uint64_t perft_divide(struct Game* game, int depth, uint64_t counts[81]);
+
+// Positions with known perft counts to check the move generation against
+struct PerftPosition
+{
+	const char* name;
+	const char* moves;
+	int depth;
+	uint64_t nodes;
+};
+extern const struct PerftPosition perftPositions[];
+extern const size_t perftPositionCount;
+
+// The transposition table uses the largest power of two number of buckets
+// that fits in the given memory. tt_memory_size tells how much of maxSize
+// that is.
+size_t tt_memory_size(size_t maxSize);
+int tt_set_memory(void* memory, size_t size);
+// Limits the table to at most maxSize bytes of its memory, 0 to use all of
+// it again. Returns the size used, the table is cleared.
+size_t tt_limit_size(size_t maxSize);
+void tt_clear();
+uint8_t tt_best_move(uint64_t hash);
+
+void search_initialize();
+// Returns the cell of the best move, or 0xFF when the game is already over.
+// The score is for the player to move.
+uint8_t search_game(struct Game* searchGame, size_t maxDepth, uint32_t timeMs, int* scoreResult);
+int search_help(size_t threadIndex);
+void search_get_stats(struct SearchStats* stats);
+
+// Provided by the platform: a millisecond clock, and a poll that stops the
+// search when it returns non-zero, for instance when input comes in.
+uint32_t timer_get_ms();
+int search_poll_stop();
+
+#endif
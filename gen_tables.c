@@ -0,0 +1,186 @@
+/* Generates the lookup tables used to evaluate the game boards. This runs on
+   the build machine, its output is compiled into the kernel as board_tables.c.
+
+   Boards are looked up by their ternary pattern: the sum of 3^index * piece
+   over all 9 positions of the board, where piece is 0 for an empty position,
+   1 for player 1 and 2 for player 2. That gives 3^9 = 19683 patterns. */
+#include <stdio.h>
+#include <stdint.h>
+
+#define PATTERN_COUNT 19683
+
+enum board_state
+{
+	UNDECIDED = 0,
+	PLAYER1_WIN = 1,
+	PLAYER2_WIN = 2,
+	DRAW = 3
+};
+
+// The 8 lines that can be completed on a 3x3 grid, as masks over the board
+// indices (y * 3 + x).
+static const uint16_t WIN_LINE_MASKS[8] =
+{
+	0x007, 0x038, 0x1C0, // Rows
+	0x049, 0x092, 0x124, // Columns
+	0x111, 0x054        // Diagonals
+};
+// The lines as scored by the evaluation: the columns, the rows and the
+// top-left to bottom-right diagonal twice. The evaluation has always walked
+// that diagonal for both of its diagonal checks, keep it that way so the
+// engine keeps playing the same moves.
+static const uint16_t SCORE_LINE_MASKS[8] =
+{
+	0x049, 0x092, 0x124, // Columns
+	0x007, 0x038, 0x1C0, // Rows
+	0x111, 0x111        // Diagonal
+};
+
+int has_line(uint16_t mask)
+{
+	for(int i = 0; i < 8; i++)
+	{
+		if((mask & WIN_LINE_MASKS[i]) == WIN_LINE_MASKS[i])
+			return 1;
+	}
+	return 0;
+}
+int bit_count(uint16_t mask)
+{
+	int count = 0;
+	for(; mask; mask &= mask - 1)
+		count++;
+	return count;
+}
+void pattern_to_masks(int pattern, uint16_t* player1Mask, uint16_t* player2Mask)
+{
+	*player1Mask = 0;
+	*player2Mask = 0;
+	for(int i = 0; i < 9; i++)
+	{
+		int piece = pattern % 3;
+		pattern /= 3;
+
+		if(piece == 1)
+			*player1Mask |= 1 << i;
+		else if(piece == 2)
+			*player2Mask |= 1 << i;
+	}
+}
+
+int score_fill_count(int countP1, int countP2, int baseScore)
+{
+	if(countP1 > 0 && countP2 > 0)
+		return 0;
+	else if(countP1 > 0)
+	{
+		if(countP1 == 1)
+			return baseScore;
+		else if(countP1 == 2)
+			return baseScore * 10;
+	}
+	else if(countP2 > 0)
+	{
+		if(countP2 == 1)
+			return -baseScore;
+		else if(countP2 == 2)
+			return -baseScore * 10;
+	}
+
+	return 0;
+}
+int score_lines(uint16_t player1Mask, uint16_t player2Mask, int baseScore)
+{
+	// Count how close either player is to completing each line
+	int totalScore = 0;
+	for(int i = 0; i < 8; i++)
+	{
+		uint16_t line = SCORE_LINE_MASKS[i];
+		totalScore += score_fill_count(bit_count(player1Mask & line), bit_count(player2Mask & line), baseScore);
+	}
+
+	return totalScore;
+}
+
+int board_state(uint16_t player1Mask, uint16_t player2Mask)
+{
+	if(has_line(player1Mask))
+		return PLAYER1_WIN;
+	else if(has_line(player2Mask))
+		return PLAYER2_WIN;
+	else if((player1Mask | player2Mask) == 0x1FF)
+		return DRAW;
+
+	return UNDECIDED;
+}
+
+void print_table_start(const char* declaration)
+{
+	printf("\n%s =\n{", declaration);
+}
+void print_table_value(int index, int value)
+{
+	printf("%s%d,", index % 16 == 0 ? "\n\t" : " ", value);
+}
+void print_table_end()
+{
+	printf("\n};\n");
+}
+
+int main()
+{
+	printf("/* Generated by gen_tables.c, do not edit. */\n");
+	printf("#include \"board_tables.h\"\n");
+
+	// Whether a 9-bit mask contains a complete line
+	print_table_start("const uint8_t line_win_table[512]");
+	for(int mask = 0; mask < 512; mask++)
+		print_table_value(mask, has_line(mask));
+	print_table_end();
+
+	// State of a board by pattern
+	print_table_start("const uint8_t board_state_table[BOARD_PATTERN_COUNT]");
+	for(int pattern = 0; pattern < PATTERN_COUNT; pattern++)
+	{
+		uint16_t player1Mask, player2Mask;
+		pattern_to_masks(pattern, &player1Mask, &player2Mask);
+		print_table_value(pattern, board_state(player1Mask, player2Mask));
+	}
+	print_table_end();
+
+	// Score of a board for player 1 by pattern. A board that has been won is
+	// worth 1000 to the winner, otherwise every line scores 10 for a single
+	// piece and 100 for two pieces of the same player.
+	print_table_start("const int16_t board_score_table[BOARD_PATTERN_COUNT]");
+	for(int pattern = 0; pattern < PATTERN_COUNT; pattern++)
+	{
+		uint16_t player1Mask, player2Mask;
+		pattern_to_masks(pattern, &player1Mask, &player2Mask);
+
+		int state = board_state(player1Mask, player2Mask);
+		int score;
+		if(state == PLAYER1_WIN)
+			score = 1000;
+		else if(state == PLAYER2_WIN)
+			score = -1000;
+		else
+			score = score_lines(player1Mask, player2Mask, 10);
+
+		print_table_value(pattern, score);
+	}
+	print_table_end();
+
+	// Score of the boards as one group for player 1. Here the pattern holds
+	// which player won each board, boards that are undecided or drawn count
+	// as empty. Every line scores 100 for a single board and 1000 for two.
+	print_table_start("const int16_t macro_score_table[BOARD_PATTERN_COUNT]");
+	for(int pattern = 0; pattern < PATTERN_COUNT; pattern++)
+	{
+		uint16_t player1Mask, player2Mask;
+		pattern_to_masks(pattern, &player1Mask, &player2Mask);
+		print_table_value(pattern, score_lines(player1Mask, player2Mask, 100));
+	}
+	print_table_end();
+
+	return 0;
+}
@@ -0,0 +1,68 @@
+# Entry points of the interrupt handlers, the IDT set up in kernel.c points
+# at these. Every stub pushes an error code (a 0 for the vectors the CPU
+# doesn't push one for) and its vector, so interrupt_handler always gets
+# the same stack layout.
+.macro ISR_NO_ERROR vector
+isr_\vector:
+	pushl $0
+	pushl $\vector
+	jmp interrupt_common
+.endm
+.macro ISR_ERROR vector
+isr_\vector:
+	pushl $\vector
+	jmp interrupt_common
+.endm
+
+.section .text
+
+# CPU exceptions
+.irp vector, 0, 1, 2, 3, 4, 5, 6, 7, 9, 15, 16, 18, 19, 20, 22, 23, 24, 25, 26, 27, 28, 31
+	ISR_NO_ERROR \vector
+.endr
+.irp vector, 8, 10, 11, 12, 13, 14, 17, 21, 29, 30
+	ISR_ERROR \vector
+.endr
+
+# IRQ 0 to 15, remapped to vector 32 to 47
+.irp vector, 32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47
+	ISR_NO_ERROR \vector
+.endr
+
+interrupt_common:
+	pushal
+	cld
+
+	# Keep the SSE registers of the interrupted code, the handlers can use
+	# them through memcpy and memset. fxsave takes a 512 byte area aligned
+	# to 16 bytes. ebx holds on to the frame, interrupt_handler doesn't
+	# change it.
+	movl %esp, %ebx
+	cmpb $0, sseEnabled
+	je .Lsaved_sse
+	subl $512, %esp
+	andl $-16, %esp
+	fxsave (%esp)
+.Lsaved_sse:
+
+	# interrupt_handler(struct InterruptFrame* frame)
+	pushl %ebx
+	call interrupt_handler
+	addl $4, %esp
+
+	cmpb $0, sseEnabled
+	je .Lrestored_sse
+	fxrstor (%esp)
+.Lrestored_sse:
+	movl %ebx, %esp
+	popal
+	addl $8, %esp               # vector and error code
+	iret
+
+.section .rodata
+.align 4
+.global interrupt_stubs
+interrupt_stubs:
+.irp vector, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47
+	.long isr_\vector
+.endr
@@ -3,6 +3,14 @@
 #endif
 #include <stddef.h>
 #include <stdint.h>
+
+#include "book.h"
+#include "engine.h"
+#include "match.h"
+#include "memory.h"
+#include "protocol.h"
+#include "solver.h"
+#include "mcts.h"
  
 /* Check if the compiler thinks if we are targeting the wrong operating system. */
 #if defined(__linux__)
@@ -14,43 +22,6 @@
 #error "This tutorial needs to be compiled with a ix86-elf compiler"
 #endif
 
-enum board_state
-{
-	UNDECIDED = 0,
-	PLAYER1_WIN = 1,
-	PLAYER2_WIN = 2,
-	DRAW = 3
-};
-enum board_piece
-{
-	NONE = 0,
-	PLAYER1 = 1,
-	PLAYER2 = 2
-};
-struct Board
-{
-	uint8_t state;
-	uint8_t emptyPieceCount;
-	uint8_t pieces[9];
-};
-struct Move
-{
-	uint8_t prevBoardXIndex;
-	uint8_t prevBoardYIndex;
-	uint8_t boardXIndex;
-	uint8_t boardYIndex;
-	uint8_t pieceXIndex;
-	uint8_t pieceYIndex;
-	uint8_t piece;
-};
-struct Game
-{
-	uint8_t curBoardXIndex;
-	uint8_t curBoardYIndex;
-	uint8_t curPlayer;
-	struct Board boards[9];
-};
- 
 /* Hardware text mode color constants. */
 enum vga_color
 {
@@ -100,22 +71,22 @@ static const size_t VGA_HEIGHT = 25;
 static const size_t GAME_BOARD_X_OFFSET = 34; // (80 - 11) / 2 = 69 / 2 = 34
 static const size_t GAME_BOARD_Y_OFFSET = 7;  // (25 - 11) / 2 = 14 / 2 = 7
 
-static const size_t MAX_MINMAX_DEPTH = 6;
-static const uint32_t MOVE_BUFFER = (uint32_t)(50 * 1024 * 1024); // Skip the first 100MB
-static const uint32_t GAME_BUFFER = (uint32_t)(300 * 1024 * 1024); // Skip the first 250MB
-static const uint32_t MAX_GAME_BUFFER_SIZE = (uint32_t)(700 * 1024 * 1024);
+static const size_t MAX_MINMAX_DEPTH = 64;
+static const uint32_t MOVE_TIME_MS = 1000; // Time the computer may think about one move
 
 size_t terminal_row;
 size_t terminal_column;
 uint8_t terminal_color;
 uint16_t* terminal_buffer;
 
-size_t moveSizeBytes;
-size_t boardSizeBytes;
-size_t gameSizeBytes;
-
-uint32_t* move_buffer;
-uint32_t* game_buffer;
+// Everything is drawn into a copy of the screen in normal memory, VGA memory
+// is slow to write and even slower to read. terminal_flush copies the cells
+// that changed to the screen, per row the span from the first to the last
+// changed cell.
+static uint16_t* const VGA_MEMORY = (uint16_t*)0xB8000;
+uint16_t terminal_shadow[25 * 80];
+uint8_t dirtyStart[25];	// First changed column of every row, VGA_WIDTH if none
+uint8_t dirtyEnd[25];		// One past the last changed column
 
 uint8_t lastPlayerMoveX = 0xFF;
 uint8_t lastPlayerMoveY = 0xFF;
@@ -160,21 +131,80 @@ static inline uint32_t inl(uint16_t port)
 
     return ret;
 }
+
+// The PIT runs at 1193182Hz. Channel 0 counts down from PIT_RELOAD over and
+// over and raises IRQ0 every time it reaches 0, about once per millisecond.
+// The interrupt handler adds up the time that passed.
+static const uint32_t PIT_FREQUENCY = 1193182;
+static const uint16_t PIT_RELOAD = 1193;
+
+uint32_t pitTickRemainder;
+volatile uint32_t timerMilliseconds;
+
+void pit_initialize()
+{
+	// Channel 0, low byte then high byte, mode 2 (rate generator), binary
+	outb(0x43, 0x34);
+	outb(0x40, PIT_RELOAD & 0xFF);
+	outb(0x40, PIT_RELOAD >> 8);
+
+	pitTickRemainder = 0;
+	timerMilliseconds = 0;
+}
+void pit_handle_irq()
+{
+	// The reload value is not exactly a millisecond, keep the rest for the
+	// next interrupt so the time doesn't drift.
+	pitTickRemainder += PIT_RELOAD * 1000;
+	timerMilliseconds += pitTickRemainder / PIT_FREQUENCY;
+	pitTickRemainder %= PIT_FREQUENCY;
+}
+uint32_t timer_get_ms()
+{
+	return timerMilliseconds;
+}
  
+void terminal_set_entry(size_t x, size_t y, uint16_t entry)
+{
+	const size_t index = y * VGA_WIDTH + x;
+	if(terminal_buffer[index] == entry)
+		return;
+
+	terminal_buffer[index] = entry;
+	if(x < dirtyStart[y])
+		dirtyStart[y] = x;
+	if(x >= dirtyEnd[y])
+		dirtyEnd[y] = x + 1;
+}
+void terminal_flush()
+{
+	for(size_t y = 0; y < VGA_HEIGHT; y++)
+	{
+		if(dirtyStart[y] < dirtyEnd[y])
+		{
+			const size_t index = y * VGA_WIDTH + dirtyStart[y];
+			memcpy(&VGA_MEMORY[index], &terminal_buffer[index], (dirtyEnd[y] - dirtyStart[y]) * sizeof(uint16_t));
+		}
+
+		dirtyStart[y] = VGA_WIDTH;
+		dirtyEnd[y] = 0;
+	}
+}
+
 void terminal_initialize()
 {
 	terminal_row = 0;
 	terminal_column = 0;
 	terminal_color = make_color(COLOR_LIGHT_GREY, COLOR_BLACK);
-	terminal_buffer = (uint16_t*) 0xB8000;
+	terminal_buffer = terminal_shadow;
+	memset16(terminal_buffer, make_vgaentry(' ', terminal_color), VGA_HEIGHT * VGA_WIDTH);
 	for ( size_t y = 0; y < VGA_HEIGHT; y++ )
 	{
-		for ( size_t x = 0; x < VGA_WIDTH; x++ )
-		{
-			const size_t index = y * VGA_WIDTH + x;
-			terminal_buffer[index] = make_vgaentry(' ', terminal_color);
-		}
+		// Nothing is known about what's on the screen yet
+		dirtyStart[y] = 0;
+		dirtyEnd[y] = VGA_WIDTH;
 	}
+	terminal_flush();
 }
  
 void terminal_setcolor(uint8_t color)
@@ -184,8 +214,7 @@ void terminal_setcolor(uint8_t color)
  
 void terminal_putentryat(char c, uint8_t color, size_t x, size_t y)
 {
-	const size_t index = y * VGA_WIDTH + x;
-	terminal_buffer[index] = make_vgaentry(c, color);
+	terminal_set_entry(x, y, make_vgaentry(c, color));
 }
 
 void terminal_setcursor(size_t x, size_t y)
@@ -202,22 +231,22 @@ void terminal_setcursor(size_t x, size_t y)
 
 void terminal_wraplines()
 {
-	// First move all lines up by one
-	for(uint8_t currentRow = 1; currentRow < VGA_HEIGHT; currentRow++)
-	{
-		uint8_t copyToRow = currentRow - 1;
-		
-		uint16_t* currentRowMemAddr = (uint16_t*)(terminal_buffer + (currentRow * VGA_WIDTH) + VGA_X_OFFSET);
-		uint16_t* copyToRowMemAddr = (uint16_t*)(terminal_buffer + (copyToRow * VGA_WIDTH) + VGA_X_OFFSET);
-
-		for(uint8_t column = 0; column < VGA_WIDTH - VGA_X_OFFSET; column++)
-			copyToRowMemAddr[column] = currentRowMemAddr[column];
-	}
+	// First move all lines up by one. The columns left of the text area
+	// stay, so every line is moved on its own.
+	const size_t width = VGA_WIDTH - VGA_X_OFFSET;
+	for(size_t row = 1; row < VGA_HEIGHT; row++)
+		memmove(&terminal_buffer[(row - 1) * VGA_WIDTH + VGA_X_OFFSET], &terminal_buffer[row * VGA_WIDTH + VGA_X_OFFSET], width * sizeof(uint16_t));
 
 	// Next clear the current bottom line
-	uint16_t* bottomLineMemAddr = (uint16_t*)(terminal_buffer + ((VGA_HEIGHT - 1) * VGA_WIDTH + VGA_X_OFFSET));
-	for(uint8_t column = 0; column < VGA_WIDTH - VGA_X_OFFSET; column++)
-		bottomLineMemAddr[column] = make_vgaentry(' ', terminal_color);
+	memset16(&terminal_buffer[(VGA_HEIGHT - 1) * VGA_WIDTH + VGA_X_OFFSET], make_vgaentry(' ', terminal_color), width);
+
+	// The whole text area goes to the screen with the next flush
+	for(size_t row = 0; row < VGA_HEIGHT; row++)
+	{
+		if(dirtyStart[row] > VGA_X_OFFSET)
+			dirtyStart[row] = VGA_X_OFFSET;
+		dirtyEnd[row] = VGA_WIDTH;
+	}
 
 	// And lastly reset the column counter
 	terminal_column = 0;
@@ -247,6 +276,9 @@ void terminal_newline()
 		// Terminal overflow, move all characters one line up
 		terminal_wraplines();
 	}
+
+	// Text shows up a line at a time
+	terminal_flush();
 }
  
 void terminal_writestring(const char* data)
@@ -306,22 +338,570 @@ void byteToHexString(unsigned char byte, char* result)
 	result[1] = nibble2 <= 9 ? '0' + nibble2 : 'A' - 10 + nibble2;
 }
 
-void reset_gameboard(struct Board* board)
+// 16550 UART on COM1, used to log to the host (QEMU -serial stdio) and to
+// speak the engine protocol (see protocol.h). There is no flow control.
+// Writes poll until the transmitter has room, received bytes raise IRQ 4
+// and are collected by serial_handle_irq.
+#define COM1_PORT 0x3F8
+#define UART_DATA 0
+#define UART_INTERRUPT_ENABLE 1
+#define UART_DIVISOR_LOW 0
+#define UART_DIVISOR_HIGH 1
+#define UART_FIFO_CONTROL 2
+#define UART_LINE_CONTROL 3
+#define UART_MODEM_CONTROL 4
+#define UART_LINE_STATUS 5
+
+#define UART_LINE_STATUS_DATA_READY 0x01
+#define UART_LINE_STATUS_TRANSMIT_EMPTY 0x20
+
+uint8_t serialPresent = 0;
+
+void serial_initialize()
 {
-	board->state = UNDECIDED;
-	board->emptyPieceCount = 9;
-	for(uint8_t i = 0; i < 9; i++)
-		board->pieces[i] = NONE;
+	outb(COM1_PORT + UART_INTERRUPT_ENABLE, 0x00);	// No interrupts until the port is known to be there
+	outb(COM1_PORT + UART_LINE_CONTROL, 0x80);		// Enable the divisor latch
+	outb(COM1_PORT + UART_DIVISOR_LOW, 1);			// 115200 baud
+	outb(COM1_PORT + UART_DIVISOR_HIGH, 0);
+	outb(COM1_PORT + UART_LINE_CONTROL, 0x03);		// 8 bits, no parity, one stop bit
+	outb(COM1_PORT + UART_FIFO_CONTROL, 0xC7);		// Enable and clear the FIFOs
+
+	// Send a byte to ourselves in loopback mode to see if the port is there,
+	// without it every write would wait forever.
+	outb(COM1_PORT + UART_MODEM_CONTROL, 0x1E);
+	outb(COM1_PORT + UART_DATA, 0xAE);
+	if(inb(COM1_PORT + UART_DATA) != 0xAE)
+		return;
+
+	// Back to normal operation with DTR, RTS and OUT2 set, OUT2 connects
+	// the interrupt line. Interrupt when data comes in.
+	outb(COM1_PORT + UART_MODEM_CONTROL, 0x0B);
+	outb(COM1_PORT + UART_INTERRUPT_ENABLE, 0x01);
+	serialPresent = 1;
 }
-void reset_game()
+
+// Lines that came in on the serial port, collected by the interrupt handler
+// and handled by the main loop. Like the key buffer the interrupt handler
+// only writes head and the main loop only writes tail. Lines that don't fit
+// are cut off.
+#define SERIAL_LINE_SIZE 256
+#define SERIAL_LINE_COUNT 8
+
+char serialLines[SERIAL_LINE_COUNT][SERIAL_LINE_SIZE];
+volatile uint32_t serialLinesHead = 0;
+volatile uint32_t serialLinesTail = 0;
+size_t serialLineLength = 0;	// Of the line at head that is still coming in
+char serialLastChar = 0;
+
+// A "stop" has to end a search that is running while the main loop waits
+// for it, so the interrupt handler counts them as they come in.
+volatile uint32_t serialStopsReceived = 0;
+uint32_t serialStopsHandled = 0;
+
+void serial_handle_irq()
 {
-	game.curBoardXIndex = 0xFF;
-	game.curBoardYIndex = 0xFF;
-	game.curPlayer = PLAYER1;
-	for(uint8_t i = 0; i < 9; i++)
+	while(inb(COM1_PORT + UART_LINE_STATUS) & UART_LINE_STATUS_DATA_READY)
+	{
+		char c = inb(COM1_PORT + UART_DATA);
+
+		// Lines may end in "\r", "\n" or "\r\n"
+		char lastChar = serialLastChar;
+		serialLastChar = c;
+		if(c == '\n' && lastChar == '\r')
+			continue;
+
+		// Drop everything while the main loop is behind
+		if(serialLinesHead - serialLinesTail >= SERIAL_LINE_COUNT)
+			continue;
+
+		char* line = serialLines[serialLinesHead % SERIAL_LINE_COUNT];
+		if(c != '\r' && c != '\n')
+		{
+			if(serialLineLength < SERIAL_LINE_SIZE - 1)
+				line[serialLineLength++] = c;
+			continue;
+		}
+
+		line[serialLineLength] = 0;
+		if(protocol_line_stops_search(line, serialLineLength))
+			serialStopsReceived++;
+		serialLineLength = 0;
+
+		__sync_synchronize();
+		serialLinesHead++;
+	}
+}
+int serial_has_line()
+{
+	return serialLinesTail != serialLinesHead;
+}
+int serial_read_line(char* result)
+{
+	if(serialLinesTail == serialLinesHead)
+		return 0;
+
+	const char* line = serialLines[serialLinesTail % SERIAL_LINE_COUNT];
+	size_t length = 0;
+	while(line[length])
+	{
+		result[length] = line[length];
+		length++;
+	}
+	result[length] = 0;
+
+	__sync_synchronize();
+	serialLinesTail++;
+	return 1;
+}
+void serial_putchar(char c)
+{
+	if(!serialPresent)
+		return;
+
+	while(!(inb(COM1_PORT + UART_LINE_STATUS) & UART_LINE_STATUS_TRANSMIT_EMPTY))
+		;
+	outb(COM1_PORT + UART_DATA, c);
+}
+void serial_writestring(const char* data)
+{
+	while(*data)
+	{
+		if(*data == '\n')
+			serial_putchar('\r');
+		serial_putchar(*data++);
+	}
+}
+void serial_print_uint(uint32_t val)
+{
+	char result[11];
+	int curIndex = 10;
+	result[curIndex] = 0;
+	do
+	{
+		result[--curIndex] = '0' + val % 10;
+		val /= 10;
+	}
+	while(val > 0);
+
+	serial_writestring(&result[curIndex]);
+}
+void serial_print_int(int val)
+{
+	if(val < 0)
+	{
+		serial_putchar('-');
+		serial_print_uint(-(uint32_t)val);
+	}
+	else
+		serial_print_uint(val);
+}
+void serial_print_fraction(uint64_t numerator, uint32_t denominator)
+{
+	// Prints numerator / denominator with two decimals
+	uint32_t hundredths = denominator ? numerator * 100 / denominator : 0;
+	serial_print_uint(hundredths / 100);
+	serial_putchar('.');
+	serial_putchar('0' + hundredths / 10 % 10);
+	serial_putchar('0' + hundredths % 10);
+}
+
+void kernel_panic(const char* message)
+{
+	terminal_setcolor(make_color(COLOR_WHITE, COLOR_RED));
+	terminal_writestring("KERNEL PANIC: ");
+	terminal_println(message);
+	terminal_flush();
+
+	serial_writestring("KERNEL PANIC: ");
+	serial_writestring(message);
+	serial_writestring("\n");
+
+	asm volatile ( "cli" );
+	while(1)
+		asm volatile ( "hlt" );
+}
+
+// The information the multiboot boot loader passes in ebx. Only the fields
+// up to the memory map are used.
+#define MULTIBOOT_BOOTLOADER_MAGIC 0x2BADB002
+#define MULTIBOOT_INFO_MEMORY (1 << 0)
+#define MULTIBOOT_INFO_CMDLINE (1 << 2)
+#define MULTIBOOT_INFO_MODS (1 << 3)
+#define MULTIBOOT_INFO_MEM_MAP (1 << 6)
+
+struct MultibootInfo
+{
+	uint32_t flags;
+	uint32_t memLower;	// KB of memory below 1MB
+	uint32_t memUpper;	// KB of memory starting at 1MB
+	uint32_t bootDevice;
+	uint32_t cmdline;
+	uint32_t modsCount;
+	uint32_t modsAddress;
+	uint32_t syms[4];
+	uint32_t mmapLength;
+	uint32_t mmapAddress;
+} __attribute__((packed));
+
+struct MultibootMmapEntry
+{
+	uint32_t size;		// Size of the entry, not counting this field
+	uint64_t address;
+	uint64_t length;
+	uint32_t type;		// 1 is RAM that may be used
+} __attribute__((packed));
+
+struct MultibootModule
+{
+	uint32_t start;
+	uint32_t end;
+	uint32_t string;
+	uint32_t reserved;
+};
+
+// Start and end of the kernel image, defined in linker.ld
+extern uint8_t kernel_start[];
+extern uint8_t kernel_end[];
+
+// Physical memory is handed out in frames of 4KB. The bitmap has a bit per
+// frame of the 4GB address space, set if the frame is in use or not RAM.
+#define FRAME_SIZE 4096
+#define MAX_FRAMES (1024 * 1024)
+
+uint32_t frameBitmap[MAX_FRAMES / 32];
+uint32_t frameCount = 0;	// Frames up to the end of the highest RAM
+uint32_t freeFrameCount = 0;
+
+static inline int frame_is_used(uint32_t frame)
+{
+	return (frameBitmap[frame / 32] >> (frame % 32)) & 1;
+}
+void frames_set_used(uint32_t first, uint32_t count, int used)
+{
+	for(uint32_t frame = first; frame < first + count && frame < MAX_FRAMES; frame++)
+	{
+		if(frame_is_used(frame) == used)
+			continue;
+
+		frameBitmap[frame / 32] ^= 1 << (frame % 32);
+		if(used)
+			freeFrameCount--;
+		else
+			freeFrameCount++;
+	}
+}
+void pmm_add_ram(uint64_t address, uint64_t length)
+{
+	// Only whole frames below 4GB can be used
+	uint64_t end = address + length;
+	if(end > (uint64_t)MAX_FRAMES * FRAME_SIZE)
+		end = (uint64_t)MAX_FRAMES * FRAME_SIZE;
+
+	uint32_t firstFrame = (address + FRAME_SIZE - 1) / FRAME_SIZE;
+	uint32_t endFrame = end / FRAME_SIZE;
+	if(firstFrame >= endFrame)
+		return;
+
+	frames_set_used(firstFrame, endFrame - firstFrame, 0);
+	if(endFrame > frameCount)
+		frameCount = endFrame;
+}
+void pmm_reserve(uint32_t address, uint32_t length)
+{
+	if(length == 0)
+		return;
+
+	// Every frame the range touches is in use
+	uint32_t firstFrame = address / FRAME_SIZE;
+	uint32_t endFrame = ((uint64_t)address + length + FRAME_SIZE - 1) / FRAME_SIZE;
+	frames_set_used(firstFrame, endFrame - firstFrame, 1);
+}
+void pmm_initialize(uint32_t multibootMagic, struct MultibootInfo* info)
+{
+	if(multibootMagic != MULTIBOOT_BOOTLOADER_MAGIC)
+		kernel_panic("Not started by a multiboot boot loader");
+
+	// Start with everything in use and free the RAM the boot loader reports
+	memset(frameBitmap, 0xFF, sizeof(frameBitmap));
+
+	if(info->flags & MULTIBOOT_INFO_MEM_MAP)
+	{
+		uint32_t address = info->mmapAddress;
+		while(address < info->mmapAddress + info->mmapLength)
+		{
+			struct MultibootMmapEntry* entry = (struct MultibootMmapEntry*)address;
+			if(entry->type == 1)
+				pmm_add_ram(entry->address, entry->length);
+			address += entry->size + sizeof(entry->size);
+		}
+	}
+	else if(info->flags & MULTIBOOT_INFO_MEMORY)
+		pmm_add_ram(0x100000, (uint64_t)info->memUpper * 1024);
+	else
+		kernel_panic("The boot loader did not report the memory size");
+
+	// The first MB holds the BIOS data, the VGA buffer and the trampoline of
+	// the other CPUs. Also keep the kernel and everything the boot loader
+	// passed to us.
+	pmm_reserve(0, 0x100000);
+	pmm_reserve((uint32_t)kernel_start, kernel_end - kernel_start);
+	pmm_reserve((uint32_t)info, sizeof(struct MultibootInfo));
+	if(info->flags & MULTIBOOT_INFO_MEM_MAP)
+		pmm_reserve(info->mmapAddress, info->mmapLength);
+	if(info->flags & MULTIBOOT_INFO_CMDLINE)
+		pmm_reserve(info->cmdline, strlen((const char*)info->cmdline) + 1);
+	if(info->flags & MULTIBOOT_INFO_MODS)
+	{
+		struct MultibootModule* modules = (struct MultibootModule*)info->modsAddress;
+		pmm_reserve(info->modsAddress, info->modsCount * sizeof(struct MultibootModule));
+		for(uint32_t i = 0; i < info->modsCount; i++)
+		{
+			pmm_reserve(modules[i].start, modules[i].end - modules[i].start);
+			if(modules[i].string)
+				pmm_reserve(modules[i].string, strlen((const char*)modules[i].string) + 1);
+		}
+	}
+}
+void* frame_alloc(uint32_t count)
+{
+	// First fit: the lowest run of count free frames
+	uint32_t runStart = 0;
+	uint32_t runLength = 0;
+	for(uint32_t frame = 0; frame < frameCount && count > 0; frame++)
+	{
+		if(frame_is_used(frame))
+		{
+			runLength = 0;
+			continue;
+		}
+
+		if(runLength++ == 0)
+			runStart = frame;
+		if(runLength == count)
+		{
+			frames_set_used(runStart, count, 1);
+			return (void*)(runStart * FRAME_SIZE);
+		}
+	}
+
+	return 0;
+}
+void frame_free(void* address, uint32_t count)
+{
+	frames_set_used((uint32_t)address / FRAME_SIZE, count, 0);
+}
+
+// An arena is one block of frames that allocations are taken from front to
+// back. Nothing is freed on its own, the whole arena is reset at once.
+struct Arena
+{
+	uint8_t* base;
+	size_t size;
+	size_t used;
+};
+
+int arena_initialize(struct Arena* arena, size_t size)
+{
+	uint32_t frames = (size + FRAME_SIZE - 1) / FRAME_SIZE;
+	arena->base = (uint8_t*)frame_alloc(frames);
+	arena->size = arena->base ? frames * FRAME_SIZE : 0;
+	arena->used = 0;
+	return arena->base != 0;
+}
+void* arena_alloc(struct Arena* arena, size_t size)
+{
+	// Keep all allocations 64 byte aligned so they start on a cache line
+	size_t start = (arena->used + 63) & ~(size_t)63;
+	if(start > arena->size || size > arena->size - start)
+		return 0;
+
+	arena->used = start + size;
+	return arena->base + start;
+}
+size_t arena_remaining(struct Arena* arena)
+{
+	size_t start = (arena->used + 63) & ~(size_t)63;
+	return start < arena->size ? arena->size - start : 0;
+}
+void arena_reset(struct Arena* arena)
+{
+	arena->used = 0;
+}
+
+// Interrupts are only handled by the CPU that booted. The 8259 PICs are
+// remapped so IRQ 0 to 15 come in at vectors 32 to 47, the vectors below
+// that are CPU exceptions. The entry points are in interrupts.s.
+#define IRQ_BASE_VECTOR 32
+#define INTERRUPT_COUNT 48
+
+static const uint16_t PIC1_COMMAND = 0x20;
+static const uint16_t PIC1_DATA = 0x21;
+static const uint16_t PIC2_COMMAND = 0xA0;
+static const uint16_t PIC2_DATA = 0xA1;
+
+struct IdtEntry
+{
+	uint16_t offsetLow;
+	uint16_t selector;
+	uint8_t zero;
+	uint8_t typeAttributes;
+	uint16_t offsetHigh;
+} __attribute__((packed));
+
+struct IdtDescriptor
+{
+	uint16_t limit;
+	uint32_t base;
+} __attribute__((packed));
+
+// What the stubs in interrupts.s leave on the stack
+struct InterruptFrame
+{
+	uint32_t edi, esi, ebp, esp, ebx, edx, ecx, eax;
+	uint32_t vector;
+	uint32_t errorCode;
+	uint32_t eip, cs, eflags;
+};
+
+extern uint32_t interrupt_stubs[INTERRUPT_COUNT];
+
+// Set by boot.s when SSE is enabled, the stubs in interrupts.s save the SSE
+// registers then
+extern uint8_t sseEnabled;
+
+struct IdtEntry idt[256];
+// Loaded by every CPU, the application processors share the IDT of the
+// bootstrap processor
+struct IdtDescriptor idtDescriptor;
+
+// Scancodes from the keyboard interrupt, read by the main loop. The
+// interrupt handler only writes head and the main loop only writes tail, so
+// no lock is needed.
+#define KEY_BUFFER_SIZE 64
+
+uint8_t keyBuffer[KEY_BUFFER_SIZE];
+volatile uint32_t keyBufferHead = 0;
+volatile uint32_t keyBufferTail = 0;
+
+void keyboard_handle_irq()
+{
+	uint8_t scancode = inb(0x60);
+
+	// Drop the key if the buffer is full
+	if(keyBufferHead - keyBufferTail >= KEY_BUFFER_SIZE)
+		return;
+
+	keyBuffer[keyBufferHead % KEY_BUFFER_SIZE] = scancode;
+	__sync_synchronize();
+	keyBufferHead++;
+}
+int keyboard_has_key()
+{
+	return keyBufferTail != keyBufferHead;
+}
+int keyboard_read(uint8_t* scancode)
+{
+	if(keyBufferTail == keyBufferHead)
+		return 0;
+
+	*scancode = keyBuffer[keyBufferTail % KEY_BUFFER_SIZE];
+	__sync_synchronize();
+	keyBufferTail++;
+	return 1;
+}
+
+#if defined(__cplusplus)
+extern "C" /* Use C linkage for interrupt_handler, it's called from interrupts.s. */
+#endif
+void interrupt_handler(struct InterruptFrame* frame)
+{
+	if(frame->vector < IRQ_BASE_VECTOR)
+	{
+		char hexStr[] = "00000000";
+		for(int i = 0; i < 4; i++)
+			byteToHexString(frame->eip >> (24 - i * 8), &hexStr[i * 2]);
+
+		terminal_writestring("CPU exception ");
+		terminal_print_int(frame->vector);
+		terminal_writestring("Error code ");
+		terminal_print_int(frame->errorCode);
+		terminal_writestring("At address 0x");
+		terminal_println(hexStr);
+		kernel_panic("Unhandled CPU exception");
+	}
+
+	uint32_t irq = frame->vector - IRQ_BASE_VECTOR;
+
+	// IRQ 7 and 15 also come in when an interrupt went away before it could
+	// be delivered. Those are only real if the PIC has the bit in service.
+	if(irq == 7 || irq == 15)
+	{
+		uint16_t command = irq == 7 ? PIC1_COMMAND : PIC2_COMMAND;
+		outb(command, 0x0B);
+		if(!(inb(command) & 0x80))
+		{
+			// The master PIC did see a real interrupt from the slave
+			if(irq == 15)
+				outb(PIC1_COMMAND, 0x20);
+			return;
+		}
+	}
+
+	if(irq == 0)
+		pit_handle_irq();
+	else if(irq == 1)
+		keyboard_handle_irq();
+	else if(irq == 4)
+		serial_handle_irq();
+
+	// End of interrupt, to both PICs if it came from the slave
+	if(irq >= 8)
+		outb(PIC2_COMMAND, 0x20);
+	outb(PIC1_COMMAND, 0x20);
+}
+
+void pic_remap()
+{
+	// Start the initialization sequence in cascade mode
+	outb(PIC1_COMMAND, 0x11);
+	outb(PIC2_COMMAND, 0x11);
+	// Vector offsets
+	outb(PIC1_DATA, IRQ_BASE_VECTOR);
+	outb(PIC2_DATA, IRQ_BASE_VECTOR + 8);
+	// The slave is connected to IRQ 2 of the master
+	outb(PIC1_DATA, 4);
+	outb(PIC2_DATA, 2);
+	// 8086 mode
+	outb(PIC1_DATA, 0x01);
+	outb(PIC2_DATA, 0x01);
+
+	// Only let the timer, the keyboard, the slave and COM1 through
+	outb(PIC1_DATA, ~((1 << 0) | (1 << 1) | (1 << 2) | (1 << 4)) & 0xFF);
+	outb(PIC2_DATA, 0xFF);
+}
+void interrupts_initialize()
+{
+	for(int i = 0; i < INTERRUPT_COUNT; i++)
 	{
-		reset_gameboard(&game.boards[i]);
+		uint32_t offset = interrupt_stubs[i];
+		idt[i].offsetLow = offset & 0xFFFF;
+		idt[i].selector = 0x08;
+		idt[i].zero = 0;
+		idt[i].typeAttributes = 0x8E;	// Present, ring 0, 32 bit interrupt gate
+		idt[i].offsetHigh = offset >> 16;
 	}
+
+	idtDescriptor.limit = sizeof(idt) - 1;
+	idtDescriptor.base = (uint32_t)idt;
+	asm volatile ( "lidt %0" : : "m"(idtDescriptor) );
+
+	pic_remap();
+
+	// Throw away a key that came in before the interrupts were set up
+	while(inb(0x64) & 1)
+		inb(0x60);
+
+	asm volatile ( "sti" );
 }
 
 void draw_gameboard(struct Board* board, uint8_t boardX, uint8_t boardY)
@@ -355,7 +935,7 @@ void draw_gameboard(struct Board* board, uint8_t boardX, uint8_t boardY)
 
 	for(uint8_t i = 0; i < 9; i++)
 	{
-		enum board_piece piece = board->pieces[i];
+		enum board_piece piece = get_board_piece(board, i);
 
 		uint8_t xOffset = i % 3;
 		uint8_t yOffset = i / 3;
@@ -430,6 +1010,8 @@ void draw_game()
 		draw_gameboard(&game.boards[i], boardXIndex, boardYIndex);
 	}
 
+	terminal_flush();
+
 	/*for(int x = 0; x < 3; x++)
 	{
 		for(int y = 0; y < 3; y++)
@@ -442,645 +1024,894 @@ void draw_game()
 	}*/
 }
 
-void put_moves_for_board(struct Board* board, int boardX, int boardY, enum board_piece player)
+unsigned int totalCallsInGame = 0;
+
+uint8_t showSearchStats = 0;
+
+// Pondering: while the player thinks, the engine searches the position it
+// expects after the player's reply. A ponder search runs until a key comes
+// in and picks up where it left off after the key has been handled, the
+// transposition table keeps what was found so far.
+uint8_t ponderEnabled = 1;
+uint8_t ponderPending = 0;	// There is a position left to ponder on
+volatile uint8_t ponderRunning = 0;
+struct Game ponderGame;
+uint32_t ponderMs;			// Time spent pondering on ponderGame so far
+int ponderDepth;			// Best result of the ponder searches so far
+int ponderScore;
+uint8_t ponderBestCell;
+unsigned int ponderHits = 0;
+
+// Time from the player's move until the engine's reply, to compare with
+// and without pondering.
+uint32_t responseMsTotal = 0;
+unsigned int responseCount = 0;
+
+// The opening book, a module the boot loader loads next to the kernel (see
+// grub.cfg). It's used where the boot loader put it, pmm_initialize has
+// reserved that memory. The "nobook" boot option turns it off.
+uint8_t bookEnabled = 1;
+
+void book_initialize(struct MultibootInfo* info)
 {
-	if(board->state != UNDECIDED || board->emptyPieceCount == 0)
+	if(!(info->flags & MULTIBOOT_INFO_MODS))
 		return;
 
-	// We generate moves by iterating over every position where a move could
-	// be made. Next we check if the position is empty (NONE), if it is we add the
-	// position as a move.
-	for(int y = 0; y < 3; y++)
+	// The first module that is a valid book
+	struct MultibootModule* modules = (struct MultibootModule*)info->modsAddress;
+	for(uint32_t i = 0; i < info->modsCount; i++)
 	{
-		for(int x = 0; x < 3; x++)
+		if(book_set_memory((const void*)modules[i].start, modules[i].end - modules[i].start))
 		{
-			int index = y * 3 + x;
-
-			if(board->pieces[index] == NONE)
-			{
-				// We found a place where we can place a piece
-				struct Move* move = (struct Move*)move_buffer;
-				move->pieceXIndex = x;
-				move->pieceYIndex = y;
-				move->boardXIndex = boardX;
-				move->boardYIndex = boardY;
-				move->piece = player;
-
-				move_buffer += moveSizeBytes;
-			}
+			serial_writestring("book positions ");
+			serial_print_uint(book_entry_count());
+			serial_writestring(" depth ");
+			serial_print_uint(book_depth());
+			serial_writestring("\n");
+			return;
 		}
 	}
 }
-uint32_t* put_moves_for_game(struct Game* game)
+
+// Per CPU data. CPU 0 is the bootstrap processor, the others are started by
+// smp_initialize.
+// The search thread of a CPU is its index, CPU i searches with search
+// thread i of the engine. What a CPU needs for searching, like its move
+// lists, killer moves and split points, is in the SearchContext of that
+// thread in the engine.
+#define MAX_CPUS MAX_SEARCH_THREADS
+
+// The kernel is compiled without optimization, then every ply of the search
+// takes about 300 bytes of stack. A KB a ply leaves room for the evaluation
+// at the leaves and for an interrupt frame with the SSE state. boot.s gives
+// the bootstrap processor a stack of the same size.
+#define CPU_STACK_SIZE (MAX_SEARCH_PLY * 1024)
+
+struct Cpu
+{
+	uint8_t index;
+	uint8_t apicId;
+	volatile uint8_t started;
+};
+
+struct Cpu cpus[MAX_CPUS];
+size_t cpuCount = 1;		// CPUs that are up and running
+
+int search_poll_stop()
+{
+	// Pondering has no time limit, it stops as soon as there's a key or a
+	// command to handle. A protocol search stops at a "stop".
+	if(ponderRunning)
+		return keyboard_has_key() || serial_has_line();
+	return protocolSearching && serialStopsReceived != serialStopsHandled;
+}
+void protocol_write(const char* text)
 {
-	uint32_t* startAddr = move_buffer;
+	serial_writestring(text);
+}
 
-	// Is a game board already selected to play on?
-	if(game->curBoardXIndex == 0xFF)
+void print_search_stats(int score)
+{
+	struct SearchStats stats;
+	search_get_stats(&stats);
+
+	terminal_writestring("CPUs: ");
+	terminal_print_int(searchThreadCount);
+	terminal_writestring("Depth: ");
+	terminal_print_int(stats.depth);
+	terminal_writestring("Nodes: ");
+	terminal_print_int(stats.nodes);
+	terminal_writestring("Splits: ");
+	terminal_print_int(stats.splits);
+	terminal_writestring("Score: ");
+	terminal_print_int(score);
+
+	// The Monte Carlo search doesn't use the transposition table
+	if(stats.playouts)
 	{
-		// First move, select moves from all boards
-		for(int i = 0; i < 9; i++)
-		{
-			put_moves_for_board(&game->boards[i], i % 3, i / 3, game->curPlayer);
-		}
+		terminal_writestring("Playouts: ");
+		terminal_print_int(stats.playouts);
+		terminal_writestring("Playouts/s: ");
+		terminal_print_int(stats.timeMs ? (uint64_t)stats.playouts * 1000 / stats.timeMs : 0);
 	}
 	else
 	{
-		// A game board is selected, but it might be that the game board
-		// has already been resolved (win, loss, draw).
-		uint8_t boardIndex = game->curBoardYIndex * 3 + game->curBoardXIndex;
-
-		struct Board* board = &game->boards[boardIndex];
-		if(board->state == UNDECIDED && board->emptyPieceCount > 0)
-		{
-			// The game is undecided, we only need to add the moves for this board
-			put_moves_for_board(board, game->curBoardXIndex, game->curBoardYIndex, game->curPlayer);
-		}
-		else
-		{
-			// The current board has already been resolved, we must add
-			// the moves of all other boards instead.
-			for(int i = 0; i < 9; i++)
-			{
-				put_moves_for_board(&game->boards[i], i % 3, i / 3, game->curPlayer);
-			}
-		}
+		// Hit and cutoff rates of the transposition table in percent
+		terminal_writestring("TT hits %: ");
+		terminal_print_int(stats.ttProbes ? stats.ttHits * 100 / stats.ttProbes : 0);
+		terminal_writestring("TT cutoffs %: ");
+		terminal_print_int(stats.ttProbes ? stats.ttCutoffs * 100 / stats.ttProbes : 0);
 	}
-
-	if(move_buffer >= GAME_BUFFER)
-		terminal_println("MOVE BUFFER OVERFLOW");
-
-	return startAddr;
 }
-enum board_piece get_next_player(enum board_piece player)
+void serial_report_move(uint8_t cell, int score, int fromPonder, int fromBook)
 {
-	return player == PLAYER1 ? PLAYER2 : PLAYER1;
-}
-void update_board_state(struct Board* board)
-{
-	// Check horizontal lines for a win situation
-	for(int y = 0; y < 3; y++)
+	// One line per engine move as name value pairs, to be collected on the
+	// host. Rates are in percent, the branching factor is the average number
+	// of moves searched per node that wasn't a leaf.
+	struct SearchStats stats;
+	search_get_stats(&stats);
+	if(fromPonder)
 	{
-		int startIndex = y * 3;
-		if(board->pieces[startIndex] != NONE &&
-		   board->pieces[startIndex] == board->pieces[startIndex + 1] &&
-		   board->pieces[startIndex + 1] == board->pieces[startIndex + 2])
-		{
-			// We have a winner!
-			board->state = board->pieces[startIndex];
-			return;
-		}
+		// Replied without searching, the search was done while pondering
+		stats.depth = ponderDepth;
+		stats.nodes = stats.timeMs = stats.playouts = 0;
+		stats.expandedNodes = stats.movesSearched = stats.betaCutoffs = stats.firstMoveCutoffs = 0;
 	}
-
-	// Check vertical lines for a win situation
-	for(int x = 0; x < 3; x++)
+	else if(fromBook)
 	{
-		if(board->pieces[x] != NONE &&
-		   board->pieces[x] == board->pieces[x + 3] &&
-		   board->pieces[x + 3] == board->pieces[x + 6])
-		{
-			// We have a winner!
-			board->state = board->pieces[x];
-			return;
-		}
+		stats.depth = book_depth();
+		stats.nodes = stats.timeMs = stats.ttCutoffs = stats.playouts = 0;
+		stats.expandedNodes = stats.movesSearched = stats.betaCutoffs = stats.firstMoveCutoffs = 0;
 	}
 
-	// Check diagonal lines for a win situation
-	if(board->pieces[0] != NONE &&
-	   board->pieces[0] == board->pieces[4] &&
-	   board->pieces[4] == board->pieces[8])
-	{
-		// We have a winner!
-		board->state = board->pieces[0];
-		return;
-	}
+	char cellText[3];
+	cell_to_string(cell, cellText);
 
-	if(board->pieces[2] != NONE &&
-	   board->pieces[2] == board->pieces[4] &&
-	   board->pieces[4] == board->pieces[6])
+	unsigned int moveNumber = 1;
+	for(int i = 0; i < 9; i++)
+		moveNumber += __builtin_popcount(game.boards[i].pieces[0] | game.boards[i].pieces[1]);
+
+	serial_writestring("move ");
+	serial_print_uint(moveNumber);
+	serial_writestring(" player ");
+	serial_writestring(game.curPlayer == PLAYER1 ? "X" : "O");
+	serial_writestring(" cpus ");
+	serial_print_uint(searchThreadCount);
+	serial_writestring(" depth ");
+	serial_print_int(stats.depth);
+	serial_writestring(" nodes ");
+	serial_print_uint(stats.nodes);
+	serial_writestring(" ms ");
+	serial_print_uint(stats.timeMs);
+	serial_writestring(" nps ");
+	serial_print_uint(stats.timeMs ? (uint64_t)stats.nodes * 1000 / stats.timeMs : 0);
+	serial_writestring(" cutoff% ");
+	serial_print_fraction((uint64_t)stats.betaCutoffs * 100, stats.expandedNodes);
+	serial_writestring(" firstcutoff% ");
+	serial_print_fraction((uint64_t)stats.firstMoveCutoffs * 100, stats.betaCutoffs);
+	serial_writestring(" branching ");
+	serial_print_fraction(stats.movesSearched, stats.expandedNodes);
+	serial_writestring(" ttcutoffs ");
+	serial_print_uint(stats.ttCutoffs);
+	serial_writestring(" ponder ");
+	serial_print_uint(fromPonder);
+	serial_writestring(" book ");
+	serial_print_uint(fromBook);
+	serial_writestring(" solved ");
+	serial_print_uint(!fromPonder && !fromBook && stats.solved);
+	serial_writestring(" playouts ");
+	serial_print_uint(stats.playouts);
+	serial_writestring(" pps ");
+	serial_print_uint(stats.timeMs ? (uint64_t)stats.playouts * 1000 / stats.timeMs : 0);
+	serial_writestring(" bestmove ");
+	serial_writestring(cellText);
+	serial_writestring(" score ");
+	serial_print_int(score);
+	serial_writestring("\n");
+}
+void do_mini_max()
+{
+	int maxScore;
+	uint8_t maxScoreCell;
+
+	// A ponder hit: the player made the move that was expected. If the
+	// engine already pondered as long as it would think about a move, reply
+	// right away. Otherwise think for the rest of the time, the searches of
+	// the first depths come straight out of the transposition table.
+	uint32_t timeMs = MOVE_TIME_MS;
+	if(ponderDepth > 0 && ponderGame.hash == game.hash)
 	{
-		// We have a winner!
-		board->state = board->pieces[2];
-		return;
+		ponderHits++;
+		timeMs = ponderMs < MOVE_TIME_MS ? MOVE_TIME_MS - ponderMs : 0;
 	}
 
-	// If we could not find a winning state and there are no empty
-	// places left the game state has become a draw.
-	if(board->emptyPieceCount == 0)
-		board->state = DRAW;
+	int fromBook = 0;
+	if(timeMs == 0)
+	{
+		maxScoreCell = ponderBestCell;
+		maxScore = ponderScore;
+		searchDepthReached = ponderDepth;
+		totalCalls = 0;
+	}
+	else if(bookEnabled && book_probe(&game, &maxScoreCell, &maxScore))
+	{
+		// The move was searched deeper than it could be now when the book
+		// was made
+		fromBook = 1;
+		searchDepthReached = book_depth();
+		totalCalls = 0;
+	}
 	else
-		board->state = UNDECIDED;
-}
+		maxScoreCell = search_game(&game, MAX_MINMAX_DEPTH, timeMs, &maxScore);
 
-int is_valid_move(struct Game* game, struct Move* move)
-{
-	// Check if the player is allowed to do a move
-	if(game->curPlayer != move->piece)
-		return 0;
+	ponderPending = 0;
+	ponderDepth = 0;
 
-	int boardIndex = move->boardYIndex * 3 + move->boardXIndex;
-	int pieceIndex = move->pieceYIndex * 3 + move->pieceXIndex;
+	// Nothing to play when the game is already over
+	if(maxScoreCell == 0xFF)
+		return;
 
-	// Check if the board is not already resolved (win, loss, draw)
-	struct Board* board = &game->boards[boardIndex];
-	if(board->state != UNDECIDED)
-		return 0;
+	struct Move maxScoreMove;
+	get_move_from_cell(&maxScoreMove, maxScoreCell, game.curPlayer);
 
-	// Check if the position is not already taken
-	if(board->pieces[pieceIndex] != NONE)
-		return 0;
+	/*terminal_println("---- Best Move ----");
+	terminal_print_int(maxScoreMove.boardXIndex);
+	terminal_print_int(maxScoreMove.boardYIndex);
+	terminal_print_int(maxScoreMove.piece);
+	terminal_print_int(maxScoreMove.pieceXIndex);
+	terminal_print_int(maxScoreMove.pieceYIndex);*/
 
-	// Check if a move can be made in the current board. A move can be made if:
-	// - The game has not yet selected a board to play on
-	// - The move board X and Y index are equal to the game current board X and Y index
-	if(game->curBoardXIndex != 0xFF)
-	{
-		enum board_state state = game->boards[game->curBoardYIndex * 3 + game->curBoardXIndex].state;
+	if(showSearchStats && !fromBook)
+		print_search_stats(maxScore);
+	serial_report_move(maxScoreCell, maxScore, timeMs == 0, fromBook);
 
-		if(state == UNDECIDED && (game->curBoardXIndex != move->boardXIndex || game->curBoardYIndex != move->boardYIndex))
-			return 0;
-	}
+	totalCallsInGame += totalCalls;
 
-	return 1;
+	// Do the best scoring move.
+	do_move(&game, &maxScoreMove);
+
+	// Store the last made move position. This is used when drawing the game board
+	// to give the last made move piece a slightly lighter color.
+	lastPlayerMoveX = maxScoreMove.boardXIndex * 3 + maxScoreMove.pieceXIndex;
+	lastPlayerMoveY = maxScoreMove.boardYIndex * 3 + maxScoreMove.pieceYIndex;
 }
 
-void do_move(struct Game* game, struct Move* move)
+void ponder_start()
 {
-	// Do the move
-	int boardIndex = move->boardYIndex * 3 + move->boardXIndex;
-	int pieceIndex = move->pieceYIndex * 3 + move->pieceXIndex;
-
-	struct Board* board = &game->boards[boardIndex];
+	ponderGame = game;
+	ponderMs = 0;
+	ponderDepth = 0;
+	ponderPending = 0;
 
-	move->prevBoardXIndex = game->curBoardXIndex;
-	move->prevBoardYIndex = game->curBoardYIndex;
+	if(!ponderEnabled || computerVScomputer)
+		return;
 
-	board->pieces[pieceIndex] = move->piece;
-	board->emptyPieceCount--;
-	game->curBoardXIndex = move->pieceXIndex;
-	game->curBoardYIndex = move->pieceYIndex;
-	game->curPlayer = get_next_player(game->curPlayer);
+	// Guess the reply of the player: the best move the search found for this
+	// position when it looked at the engine's move.
+	uint8_t guessCell = tt_best_move(game.hash);
+	if(guessCell != 0xFF)
+	{
+		struct Move move;
+		get_move_from_cell(&move, guessCell, game.curPlayer);
+		if(is_valid_move(&ponderGame, &move))
+			do_move(&ponderGame, &move);
+	}
 
-	update_board_state(board);
+	// Without a guess search the position of the player itself, that still
+	// fills the transposition table with the replies to all moves.
+	ponderPending = get_winning_player(&ponderGame) == UNDECIDED;
 }
-void undo_move(struct Game* game, struct Move* move)
+void ponder()
 {
-	// Do the move
-	int boardIndex = move->boardYIndex * 3 + move->boardXIndex;
-	int pieceIndex = move->pieceYIndex * 3 + move->pieceXIndex;
+	uint32_t startMs = timer_get_ms();
 
-	struct Board* board = &game->boards[boardIndex];
+	int score;
+	ponderRunning = 1;
+	uint8_t cell = search_game(&ponderGame, MAX_MINMAX_DEPTH, 0xFFFFFFFF, &score);
+	ponderRunning = 0;
 
-	board->pieces[pieceIndex] = NONE;
-	board->emptyPieceCount++;
-	game->curBoardXIndex = move->prevBoardXIndex;
-	game->curBoardYIndex = move->prevBoardYIndex;
-	game->curPlayer = get_next_player(game->curPlayer);
+	ponderMs += timer_get_ms() - startMs;
 
-	// When undoing a move we can just reset the board state to UNDECIDED
-	// because no matter what, undoing a move can never result in a win or draw state.
-	board->state = UNDECIDED;
+	// Only a search of the guessed position gives a move to reply with
+	if(ponderGame.curPlayer != game.curPlayer && searchDepthReached > 0 && searchDepthReached >= ponderDepth)
+	{
+		ponderDepth = searchDepthReached;
+		ponderScore = score;
+		ponderBestCell = cell;
+	}
+
+	// Done once the search finished without a key coming in
+	if(!searchAborted)
+		ponderPending = 0;
 }
-struct Game* copy_game(struct Game* game)
+void record_response_time(uint32_t ms)
 {
-	struct Game* copiedGame = (struct Game*)game_buffer;
-	game_buffer += gameSizeBytes;
-
-	if(game_buffer >= MAX_GAME_BUFFER_SIZE)
-		terminal_println("GAME BUFFER OVERFLOW");
-
-	uint8_t* copyFromPtr = (uint8_t*)game;
-	uint8_t* copyToPtr = (uint8_t*)copiedGame;
+	responseMsTotal += ms;
+	responseCount++;
 
-	// Copy game to copiedGame
-	for(size_t i = 0; i < gameSizeBytes; i++)
+	if(showSearchStats)
 	{
-		copyToPtr[i] = copyFromPtr[i];
+		terminal_writestring("Response ms: ");
+		terminal_print_int(ms);
+		terminal_writestring("Average response ms: ");
+		terminal_print_int(responseMsTotal / responseCount);
+		terminal_writestring("Ponder hits: ");
+		terminal_print_int(ponderHits);
 	}
-
-	return copiedGame;
 }
-struct Game* copy_game_and_do_move(struct Game* game, struct Move* move)
-{
-	struct Game* copiedGame = copy_game(game);
 
-	do_move(copiedGame, move);
+// All memory the search uses comes from one arena: the transposition table
+// and whatever else the search needs.
+struct Arena searchArena;
 
-	return copiedGame;
-}
+// Memory left to the frame allocator for anything other than the search
+#define SEARCH_ARENA_HEADROOM (1024 * 1024)
 
-enum board_piece get_winning_player(struct Game* game)
+void search_memory_initialize()
+{
+	// Take all free memory but the headroom. It has to be one block, so if
+	// the free memory is split up try smaller sizes.
+	uint32_t headroomFrames = SEARCH_ARENA_HEADROOM / FRAME_SIZE;
+	uint32_t frames = freeFrameCount > headroomFrames ? freeFrameCount - headroomFrames : freeFrameCount;
+	while(frames > 0 && !arena_initialize(&searchArena, frames * FRAME_SIZE))
+		frames -= frames / 8 > 0 ? frames / 8 : 1;
+
+	if(frames == 0)
+		kernel_panic("Not enough memory for the search");
+}
+void tt_initialize()
 {
-	// Check the rows
-	uint8_t row1 = game->boards[0].state * game->boards[1].state * game->boards[2].state;
-	if(row1 == 1)
-		return PLAYER1_WIN;
-	else if(row1 == 8)
-		return PLAYER2_WIN;
+	// The transposition table gets the largest power of two number of
+	// buckets that fits in half of the search arena.
+	size_t size = tt_memory_size(arena_remaining(&searchArena) / 2);
+	void* memory = arena_alloc(&searchArena, size);
+	if(!memory || !tt_set_memory(memory, size))
+		kernel_panic("Not enough memory for the transposition table");
+
+	// The node pool of the endgame solver gets half of what's left. Without
+	// it the search does all the work.
+	size = arena_remaining(&searchArena) / 2;
+	memory = arena_alloc(&searchArena, size);
+	if(memory)
+		solver_set_memory(memory, size);
+
+	// And the tree of the Monte Carlo search half of what's left after
+	// that. Without it the mcts option does nothing.
+	size = arena_remaining(&searchArena) / 2;
+	memory = arena_alloc(&searchArena, size);
+	if(memory)
+		mcts_set_memory(memory, size);
+}
 
-	uint8_t row2 = game->boards[3].state * game->boards[4].state * game->boards[5].state;
-	if(row2 == 1)
-		return PLAYER1_WIN;
-	else if(row2 == 8)
-		return PLAYER2_WIN;
+// Local APIC registers, as offsets from the local APIC base address
+static const uint32_t LAPIC_ID = 0x20;
+static const uint32_t LAPIC_SPURIOUS_VECTOR = 0xF0;
+static const uint32_t LAPIC_ERROR_STATUS = 0x280;
+static const uint32_t LAPIC_ICR_LOW = 0x300;
+static const uint32_t LAPIC_ICR_HIGH = 0x310;
 
-	uint8_t row3 = game->boards[6].state * game->boards[7].state * game->boards[8].state;
-	if(row3 == 1)
-		return PLAYER1_WIN;
-	else if(row3 == 8)
-		return PLAYER2_WIN;
+// The application processors start in real mode at a page below 1MB. The
+// trampoline in smp.s gets copied there, it switches to protected mode and
+// calls ap_main on the stack in apBootStack.
+static const uint32_t AP_TRAMPOLINE_ADDRESS = 0x8000;
 
-	// Check the columns
-	uint8_t col1 = game->boards[0].state * game->boards[3].state * game->boards[6].state;
-	if(col1 == 1)
-		return PLAYER1_WIN;
-	else if(col1 == 8)
-		return PLAYER2_WIN;
+extern uint8_t ap_trampoline_start[];
+extern uint8_t ap_trampoline_end[];
 
-	uint8_t col2 = game->boards[1].state * game->boards[4].state * game->boards[7].state;
-	if(col2 == 1)
-		return PLAYER1_WIN;
-	else if(col2 == 8)
-		return PLAYER2_WIN;
+volatile uint32_t* lapic = (volatile uint32_t*)0xFEE00000;
 
-	uint8_t col3 = game->boards[2].state * game->boards[5].state * game->boards[8].state;
-	if(col3 == 1)
-		return PLAYER1_WIN;
-	else if(col3 == 8)
-		return PLAYER2_WIN;
+uint8_t cpuStacks[MAX_CPUS][CPU_STACK_SIZE] __attribute__((aligned(16)));
+volatile uint32_t apBootStack;
+struct Cpu* volatile apStartingCpu;
 
-	// Check the diagonals
-	uint8_t diag1 = game->boards[0].state * game->boards[4].state * game->boards[8].state;
-	if(diag1 == 1)
-		return PLAYER1_WIN;
-	else if(diag1 == 8)
-		return PLAYER2_WIN;
+uint8_t runSmpBenchmark = 0;
+static const size_t SMP_BENCHMARK_DEPTH = 9;
 
-	uint8_t diag2 = game->boards[2].state * game->boards[4].state * game->boards[6].state;
-	if(diag2 == 1)
-		return PLAYER1_WIN;
-	else if(diag2 == 8)
-		return PLAYER2_WIN;
+struct AcpiRsdp
+{
+	char signature[8];
+	uint8_t checksum;
+	char oemId[6];
+	uint8_t revision;
+	uint32_t rsdtAddress;
+} __attribute__((packed));
+
+struct AcpiSdtHeader
+{
+	char signature[4];
+	uint32_t length;
+	uint8_t revision;
+	uint8_t checksum;
+	char oemId[6];
+	char oemTableId[8];
+	uint32_t oemRevision;
+	uint32_t creatorId;
+	uint32_t creatorRevision;
+} __attribute__((packed));
+
+struct AcpiMadt
+{
+	struct AcpiSdtHeader header;
+	uint32_t localApicAddress;
+	uint32_t flags;
+	// Followed by a list of variable length entries
+} __attribute__((packed));
 
-	for(int i = 0; i < 9; i++)
-	{
-		if(game->boards[i].state == UNDECIDED)
-			return UNDECIDED;
-	}
+static inline uint32_t lapic_read(uint32_t reg)
+{
+	return lapic[reg / 4];
+}
+static inline void lapic_write(uint32_t reg, uint32_t value)
+{
+	lapic[reg / 4] = value;
+}
 
-	return DRAW;
+void timer_wait_ms(uint32_t ms)
+{
+	// The timer may be just about to tick, wait one extra millisecond to be sure
+	uint32_t start = timer_get_ms();
+	while(timer_get_ms() - start <= ms);
 }
 
-int score_fill_count(int countP1, int countP2, int baseScore)
+uint16_t read_bda16(uintptr_t offset)
 {
-	if(countP1 > 0 && countP2 > 0)
-		return 0;
-	else if(countP1 > 0)
+	// The BIOS data area starts at 0x400. The address goes through a
+	// volatile variable, GCC takes a constant pointer this close to 0 for an
+	// offset from a null pointer and warns about reading out of its bounds.
+	volatile uintptr_t address = 0x400 + offset;
+	return *(volatile uint16_t*)address;
+}
+int bytes_equal(const void* data, const char* expected, size_t length)
+{
+	const uint8_t* bytes = (const uint8_t*)data;
+	for(size_t i = 0; i < length; i++)
 	{
-		if(countP1 == 1)
-			return baseScore;
-		else if(countP1 == 2)
-			return baseScore * 10;
+		if(bytes[i] != (uint8_t)expected[i])
+			return 0;
 	}
-	else if(countP2 > 0)
+	return 1;
+}
+int acpi_checksum_valid(const void* data, size_t length)
+{
+	// All bytes of an ACPI structure add up to 0
+	const uint8_t* bytes = (const uint8_t*)data;
+	uint8_t sum = 0;
+	for(size_t i = 0; i < length; i++)
+		sum += bytes[i];
+	return sum == 0;
+}
+struct AcpiRsdp* acpi_find_rsdp_in(uint32_t start, uint32_t end)
+{
+	// The RSDP is always aligned on a 16 byte boundary
+	for(uint32_t address = start; address + sizeof(struct AcpiRsdp) <= end; address += 16)
 	{
-		if(countP2 == 1)
-			return -baseScore;
-		else if(countP2 == 2)
-			return -baseScore * 10;
+		struct AcpiRsdp* rsdp = (struct AcpiRsdp*)address;
+		if(bytes_equal(rsdp->signature, "RSD PTR ", 8) && acpi_checksum_valid(rsdp, sizeof(struct AcpiRsdp)))
+			return rsdp;
 	}
-
 	return 0;
 }
-int evaluate_board_for_player(struct Board* board, enum board_piece playerToEvaluate)
+struct AcpiMadt* acpi_find_madt()
 {
-	if(board->state != UNDECIDED && board->state != DRAW)
-	{
-		// Board is already decided
-		return board->state == playerToEvaluate ? 1000 : -1000;
-	}
+	// The RSDP is either in the first KB of the extended BIOS data area or in
+	// the BIOS area between 0xE0000 and 0xFFFFF.
+	uint32_t ebdaAddress = (uint32_t)read_bda16(0x0E) << 4;
+	struct AcpiRsdp* rsdp = 0;
+	if(ebdaAddress)
+		rsdp = acpi_find_rsdp_in(ebdaAddress, ebdaAddress + 1024);
+	if(!rsdp)
+		rsdp = acpi_find_rsdp_in(0xE0000, 0x100000);
+	if(!rsdp)
+		return 0;
 
-	// Count how close either player is to winning this board
-	int totalScore = 0;
-	int thisPlayerCount = 0;
-	int otherPlayerCount = 0;
+	struct AcpiSdtHeader* rsdt = (struct AcpiSdtHeader*)rsdp->rsdtAddress;
+	if(!bytes_equal(rsdt->signature, "RSDT", 4) || !acpi_checksum_valid(rsdt, rsdt->length))
+		return 0;
 
-	// Check each row
-	for(int x = 0; x < 3; x++)
+	// The RSDT is followed by the addresses of all other tables, look for the
+	// MADT which has the signature "APIC".
+	uint32_t* tableAddresses = (uint32_t*)(rsdt + 1);
+	size_t tableCount = (rsdt->length - sizeof(struct AcpiSdtHeader)) / 4;
+	for(size_t i = 0; i < tableCount; i++)
 	{
-		thisPlayerCount = 0;
-		otherPlayerCount = 0;
+		struct AcpiSdtHeader* table = (struct AcpiSdtHeader*)tableAddresses[i];
+		if(bytes_equal(table->signature, "APIC", 4) && acpi_checksum_valid(table, table->length))
+			return (struct AcpiMadt*)table;
+	}
 
-		for(int y = 0; y < 3; y++)
-		{
-			enum board_piece piece = board->pieces[y * 3 + x];
-			if(piece == playerToEvaluate)
-				thisPlayerCount++;
-			else if(piece != NONE)
-				otherPlayerCount++;
-		}
+	return 0;
+}
 
-		totalScore += score_fill_count(thisPlayerCount, otherPlayerCount, 10);
-	}
+void lapic_wait_for_delivery()
+{
+	// Bit 12 of the ICR stays set until the interrupt has been sent
+	while(lapic_read(LAPIC_ICR_LOW) & (1 << 12))
+		asm volatile ( "pause" );
+}
+void lapic_send_ipi(uint8_t apicId, uint32_t command)
+{
+	lapic_write(LAPIC_ERROR_STATUS, 0);
+	lapic_write(LAPIC_ICR_HIGH, apicId << 24);
+	lapic_write(LAPIC_ICR_LOW, command);
+	lapic_wait_for_delivery();
+}
 
-	// Check each column
-	for(int y = 0; y < 3; y++)
-	{
-		thisPlayerCount = 0;
-		otherPlayerCount = 0;
+#if defined(__cplusplus)
+extern "C" /* Use C linkage for ap_main, it's called from smp.s. */
+#endif
+void ap_main()
+{
+	struct Cpu* cpu = apStartingCpu;
 
-		for(int x = 0; x < 3; x++)
-		{
-			enum board_piece piece = board->pieces[y * 3 + x];
-			if(piece == playerToEvaluate)
-				thisPlayerCount++;
-			else if(piece != NONE)
-				otherPlayerCount++;
-		}
+	// Without an IDT an exception or an NMI on this CPU would reset the
+	// whole machine. The interrupts stay off, the PIC only interrupts the
+	// bootstrap processor.
+	asm volatile ( "lidt %0" : : "m"(idtDescriptor) );
 
-		totalScore += score_fill_count(thisPlayerCount, otherPlayerCount, 10);
-	}
+	lapic_write(LAPIC_SPURIOUS_VECTOR, 0x1FF);
+	cpu->started = 1;
 
-	// Check the two diagonals
-	thisPlayerCount = 0;
-	otherPlayerCount = 0;
-	for(int i = 0; i < 3; i++)
+	// Help out with the searches of the other CPUs
+	while(1)
 	{
-		enum board_piece piece = board->pieces[i * 3 + i];
-		if(piece == playerToEvaluate)
-			thisPlayerCount++;
-		else if(piece != NONE)
-			otherPlayerCount++;
+		if(!search_help(cpu->index))
+			asm volatile ( "pause" );
 	}
-	totalScore += score_fill_count(thisPlayerCount, otherPlayerCount, 10);
+}
 
-	thisPlayerCount = 0;
-	otherPlayerCount = 0;
-	for(int i = 2; i >= 0; i--)
+int smp_start_cpu(struct Cpu* cpu)
+{
+	apStartingCpu = cpu;
+	apBootStack = (uint32_t)&cpuStacks[cpu->index][CPU_STACK_SIZE];
+	__sync_synchronize();
+
+	// INIT, wait 10ms and then send the startup IPI twice. The vector of the
+	// startup IPI is the page the trampoline is at.
+	lapic_send_ipi(cpu->apicId, 0x4500);
+	timer_wait_ms(10);
+	for(int i = 0; i < 2 && !cpu->started; i++)
 	{
-		enum board_piece piece = board->pieces[i * 3 + i];
-		if(piece == playerToEvaluate)
-			thisPlayerCount++;
-		else if(piece != NONE)
-			otherPlayerCount++;
+		lapic_send_ipi(cpu->apicId, 0x4600 | (AP_TRAMPOLINE_ADDRESS >> 12));
+		timer_wait_ms(1);
 	}
-	totalScore += score_fill_count(thisPlayerCount, otherPlayerCount, 10);
 
-	return totalScore;
+	// Give the CPU some time to get to ap_main
+	uint32_t start = timer_get_ms();
+	while(!cpu->started && timer_get_ms() - start < 100);
+
+	return cpu->started;
 }
-int evaluate_game_for_player(struct Game* game, enum board_piece playerToEvaluate)
+void smp_initialize()
 {
-	enum board_piece winningPlayer = get_winning_player(game);
-	if(winningPlayer == playerToEvaluate)
-		return 1000000;
-	else if(winningPlayer == DRAW)
-		return 0;
-	else if(winningPlayer != UNDECIDED)
-		return -1000000;
-
-	int totalScore = 0;
-
-	// Evaluate each individual board
-	for(int i = 0; i < 9; i++)
+	for(size_t i = 0; i < MAX_CPUS; i++)
 	{
-		totalScore += evaluate_board_for_player(&game->boards[i], playerToEvaluate);
+		cpus[i].index = i;
 	}
 
-	// Evaluate the boards as one group
-	// Count how close either player is to winning this game
-	int thisPlayerCount = 0;
-	int otherPlayerCount = 0;
+	cpus[0].started = 1;
+	cpuCount = 1;
+	searchThreadCount = 1;
 
-	// Check each row
-	for(int x = 0; x < 3; x++)
-	{
-		thisPlayerCount = 0;
-		otherPlayerCount = 0;
+	struct AcpiMadt* madt = acpi_find_madt();
+	if(!madt)
+		return;
 
-		for(int y = 0; y < 3; y++)
-		{
-			enum board_state state = game->boards[y * 3 + x].state;
-			if(state == playerToEvaluate)
-				thisPlayerCount++;
-			else if(state != UNDECIDED && state != DRAW)
-				otherPlayerCount++;
-		}
+	lapic = (volatile uint32_t*)madt->localApicAddress;
+	lapic_write(LAPIC_SPURIOUS_VECTOR, 0x1FF);
+	cpus[0].apicId = lapic_read(LAPIC_ID) >> 24;
 
-		totalScore += score_fill_count(thisPlayerCount, otherPlayerCount, 100);
-	}
+	// Copy the trampoline to where the application processors start
+	memcpy((void*)AP_TRAMPOLINE_ADDRESS, ap_trampoline_start, ap_trampoline_end - ap_trampoline_start);
 
-	// Check each column
-	for(int y = 0; y < 3; y++)
+	// Walk the MADT entries, every enabled processor local APIC (type 0)
+	// other than our own is a CPU to start.
+	uint8_t* entry = (uint8_t*)(madt + 1);
+	uint8_t* end = (uint8_t*)madt + madt->header.length;
+	while(entry < end && cpuCount < MAX_CPUS)
 	{
-		thisPlayerCount = 0;
-		otherPlayerCount = 0;
+		uint8_t type = entry[0];
+		uint8_t length = entry[1];
+		if(length == 0)
+			break;
 
-		for(int x = 0; x < 3; x++)
+		if(type == 0)
 		{
-			enum board_state state = game->boards[y * 3 + x].state;
-			if(state == playerToEvaluate)
-				thisPlayerCount++;
-			else if(state != UNDECIDED && state != DRAW)
-				otherPlayerCount++;
-		}
-
-		totalScore += score_fill_count(thisPlayerCount, otherPlayerCount, 100);
-	}
+			uint8_t apicId = entry[3];
+			uint32_t flags = *(uint32_t*)&entry[4];
 
-	// Check the two diagonals
-	thisPlayerCount = 0;
-	otherPlayerCount = 0;
-	for(int i = 0; i < 3; i++)
-	{
-		enum board_state state = game->boards[i * 3 + i].state;
-		if(state == playerToEvaluate)
-			thisPlayerCount++;
-		else if(state != UNDECIDED && state != DRAW)
-			otherPlayerCount++;
-	}
-	totalScore += score_fill_count(thisPlayerCount, otherPlayerCount, 100);
+			if((flags & 1) && apicId != cpus[0].apicId)
+			{
+				struct Cpu* cpu = &cpus[cpuCount];
+				cpu->apicId = apicId;
+				if(smp_start_cpu(cpu))
+					cpuCount++;
+			}
+		}
 
-	thisPlayerCount = 0;
-	otherPlayerCount = 0;
-	for(int i = 2; i >= 0; i--)
-	{
-		enum board_state state = game->boards[i * 3 + i].state;
-		if(state == playerToEvaluate)
-			thisPlayerCount++;
-		else if(state != UNDECIDED && state != DRAW)
-			otherPlayerCount++;
+		entry += length;
 	}
-	totalScore += score_fill_count(thisPlayerCount, otherPlayerCount, 100);
 
-	return totalScore;
+	searchThreadCount = cpuCount;
 }
 
-unsigned int totalCalls = 0;
-unsigned int totalCallsInGame = 0;
-int do_min_max_rec(struct Game* game, int depth, enum board_piece playerToDoMove, int alpha, int beta)
+void run_smp_benchmark()
 {
-	totalCalls++;
+	// Time to depth: search the start position to a fixed depth on 1 CPU,
+	// then on 2, 4 and so on up to all of them.
+	uint32_t singleCpuMs = 0;
+	size_t availableCpus = cpuCount;
 
-	if(depth == 0)
+	for(size_t cpusUsed = 1; ; cpusUsed *= 2)
 	{
-		// Max depth reached, return the score for the given game for the player who ultimately is going to do a move
-		return evaluate_game_for_player(game, playerToDoMove);
+		if(cpusUsed > availableCpus)
+			cpusUsed = availableCpus;
+
+		reset_game(&game);
+		tt_clear();
+		searchThreadCount = cpusUsed;
+
+		int score;
+		uint32_t startMs = timer_get_ms();
+		search_game(&game, SMP_BENCHMARK_DEPTH, 0xFFFFFFFF, &score);
+		uint32_t elapsedMs = timer_get_ms() - startMs;
+		if(cpusUsed == 1)
+			singleCpuMs = elapsedMs;
+
+		terminal_writestring("CPUs: ");
+		terminal_print_int(cpusUsed);
+		terminal_writestring("Time ms: ");
+		terminal_print_int(elapsedMs);
+		terminal_writestring("Nodes: ");
+		terminal_print_int(totalCalls);
+
+		// Speedup over one CPU, in hundredths
+		terminal_writestring("Speedup x100: ");
+		terminal_print_int(elapsedMs ? singleCpuMs * 100 / elapsedMs : 0);
+
+		if(cpusUsed == availableCpus)
+			break;
 	}
 
-	enum board_piece winningPlayer = get_winning_player(game);
-	if(winningPlayer == playerToDoMove)
-		return 1000000 * (depth + 1);
-	else if(winningPlayer == DRAW)
-		return 0;
-	else if(winningPlayer != UNDECIDED)
-		return -1000000 * (depth + 1);
-
-	uint32_t* baseMoveBuffer = move_buffer;
-	uint32_t* baseGameBuffer = game_buffer;
+	tt_clear();
+	reset_game(&game);
+}
 
-	// This is not the last depth, generate a new set of moves
-	uint32_t* firstMovePtr = put_moves_for_game(game);
+uint8_t runPerft = 0;
 
-	unsigned int movesGenerated = (move_buffer - firstMovePtr) / moveSizeBytes;
-	if(movesGenerated == 0)
+void run_perft_suite()
+{
+	// Count the positions of the reference positions and compare them with
+	// the known counts, to check the move generation on the real hardware.
+	int failures = 0;
+	for(size_t i = 0; i < perftPositionCount; i++)
 	{
-		return evaluate_game_for_player(game, playerToDoMove);
+		const struct PerftPosition* position = &perftPositions[i];
+
+		struct Game perftGame;
+		reset_game(&perftGame);
+		play_moves(&perftGame, position->moves);
+
+		uint32_t startMs = timer_get_ms();
+		uint64_t nodes = perft(&perftGame, position->depth);
+		uint32_t elapsedMs = timer_get_ms() - startMs;
+
+		terminal_writestring("Perft ");
+		terminal_writestring(position->name);
+		terminal_writestring(" depth ");
+		terminal_print_int(position->depth);
+		terminal_writestring("Nodes: ");
+		terminal_print_int((int)nodes);
+		if(nodes != position->nodes)
+		{
+			failures++;
+			terminal_writestring("FAIL, expected: ");
+			terminal_print_int((int)position->nodes);
+		}
+		terminal_writestring("Time ms: ");
+		terminal_print_int(elapsedMs);
+		terminal_writestring("Nodes/s: ");
+		terminal_print_int(elapsedMs ? (int)(nodes * 1000 / elapsedMs) : 0);
 	}
 
-	int bestScore = game->curPlayer == playerToDoMove ? -1000000000 : 1000000000;
+	terminal_println(failures ? "Perft FAILED" : "Perft OK");
 
-	for(unsigned int i = 0; i < movesGenerated; i++)
+	// And the endgame solver against a plain negamax on the reference
+	// endgames, the solver decides the last moves of every game
+	failures = 0;
+	for(size_t i = 0; i < solverPositionCount; i++)
 	{
-		struct Move* move = (struct Move*)(firstMovePtr + (i * moveSizeBytes));
-
-		struct Game* copiedGame = copy_game_and_do_move(game, move);
-
-		//do_move(game, move);
-		int score = do_min_max_rec(copiedGame, depth - 1, playerToDoMove, alpha, beta);
-		//undo_move(game, move);
-
-		if(game->curPlayer == playerToDoMove)
+		const struct SolverPosition* position = &solverPositions[i];
+
+		struct SolverResult solved = { 0, 0, 0 };
+		struct SolverResult negamax = { 0, 0, 0 };
+		unsigned int nodes = 0;
+		uint32_t startMs = timer_get_ms();
+		int ok = solver_check(position, &solved, &negamax, &nodes);
+		uint32_t elapsedMs = timer_get_ms() - startMs;
+
+		terminal_writestring("Solver ");
+		terminal_writestring(position->name);
+		terminal_writestring(" value ");
+		terminal_print_int(solved.value);
+		terminal_writestring("Distance: ");
+		terminal_print_int(solved.distance);
+		if(!ok)
 		{
-			// Try and maximize the score
-			if(score > bestScore)
-				bestScore = score;
-
-			if(score > alpha)
-				alpha = score;
+			failures++;
+			terminal_writestring("FAIL, negamax: ");
+			terminal_print_int(negamax.value);
+			terminal_writestring("Distance: ");
+			terminal_print_int(negamax.distance);
+			terminal_writestring("Expected: ");
+			terminal_print_int(position->value);
+			terminal_writestring("Distance: ");
+			terminal_print_int(position->distance);
 		}
-		else
-		{
-			// Try and minimize the score
-			if(score < bestScore)
-				bestScore = score;
+		terminal_writestring("Time ms: ");
+		terminal_print_int(elapsedMs);
+	}
 
-			if(score < beta)
-				beta = score;
-		}
+	terminal_println(failures ? "Solver FAILED" : "Solver OK");
+}
 
-		// Check if we can prune this tree
-		if(beta <= alpha)
-			break;
-	}
+// Memory benchmark, started with the "membench" boot option. Compares the
+// byte loops the kernel used to copy and clear memory with memcpy, memset
+// and memmove at a few sizes. The results go to the screen and the serial
+// port.
+uint8_t runMemoryBenchmark = 0;
 
-	// Reset game and move buffer to where it was at the start of this function.
-	// This effectively recycles used memory.
-	move_buffer = baseMoveBuffer;
-	game_buffer = baseGameBuffer;
+#define MEMBENCH_BUFFER_SIZE (1024 * 1024)
+#define MEMBENCH_MIN_MS 100
 
-	return bestScore;
+// GCC would turn these loops into calls to memcpy and memset
+__attribute__((optimize("no-tree-loop-distribute-patterns"))) void membench_byte_copy(uint8_t* destination, const uint8_t* source, size_t size)
+{
+	for(size_t i = 0; i < size; i++)
+		destination[i] = source[i];
 }
-void do_mini_max()
+__attribute__((optimize("no-tree-loop-distribute-patterns"))) void membench_byte_set(uint8_t* destination, const uint8_t* source, size_t size)
 {
-	move_buffer = MOVE_BUFFER;
-	game_buffer = GAME_BUFFER;
-	totalCalls = 0;
-
-	// Generate the first set of moves
-	uint32_t* firstMovePtr = put_moves_for_game(&game);
-
-	unsigned int movesGenerated = (move_buffer - firstMovePtr) / moveSizeBytes;
+	(void)source;
+	for(size_t i = 0; i < size; i++)
+		destination[i] = 0;
+}
+void membench_memcpy(uint8_t* destination, const uint8_t* source, size_t size)
+{
+	memcpy(destination, source, size);
+}
+void membench_memset(uint8_t* destination, const uint8_t* source, size_t size)
+{
+	(void)source;
+	memset(destination, 0, size);
+}
+void membench_memmove(uint8_t* destination, const uint8_t* source, size_t size)
+{
+	// Overlapping with the destination behind the source, so it copies
+	// back to front
+	(void)source;
+	memmove(destination + 1, destination, size - 1);
+}
 
-	int maxScore = -1000000000;
-	struct Move* maxScoreMove;
+struct MemoryBenchmark
+{
+	const char* name;
+	void (*function)(uint8_t* destination, const uint8_t* source, size_t size);
+};
+const struct MemoryBenchmark memoryBenchmarks[] =
+{
+	{ "byte copy", membench_byte_copy },
+	{ "memcpy", membench_memcpy },
+	{ "memmove", membench_memmove },
+	{ "byte set", membench_byte_set },
+	{ "memset", membench_memset }
+};
 
-	// For every move create a new board and recursively do mini max
-	for(unsigned int i = 0; i < movesGenerated; i++)
+uint32_t membench_run(const struct MemoryBenchmark* benchmark, uint8_t* destination, const uint8_t* source, size_t size)
+{
+	// Repeats the function until the timer has seen enough of it, returns
+	// the MB/s
+	size_t repetitions = MEMBENCH_BUFFER_SIZE / size;
+	uint64_t bytes = 0;
+	uint32_t startMs = timer_get_ms();
+	uint32_t elapsedMs;
+	do
 	{
-		struct Move* move = (struct Move*)(firstMovePtr + (i * moveSizeBytes));
-
-		struct Game* copiedGame = copy_game_and_do_move(&game, move);
+		for(size_t i = 0; i < repetitions; i++)
+			benchmark->function(destination, source, size);
+		bytes += (uint64_t)repetitions * size;
+		elapsedMs = timer_get_ms() - startMs;
+	}
+	while(elapsedMs < MEMBENCH_MIN_MS);
 
-		//do_move(&game, move);
-		int score = do_min_max_rec(copiedGame, MAX_MINMAX_DEPTH - 1, game.curPlayer, maxScore, 1000000000);
-		//undo_move(&game, move);
+	return bytes * 1000 / elapsedMs / (1024 * 1024);
+}
+void run_memory_benchmark()
+{
+	// The buffers come from the part of the search arena the transposition
+	// table left over, and go back to it afterwards
+	size_t arenaUsed = searchArena.used;
+	uint8_t* source = arena_alloc(&searchArena, MEMBENCH_BUFFER_SIZE);
+	uint8_t* destination = arena_alloc(&searchArena, MEMBENCH_BUFFER_SIZE);
+	if(!source || !destination)
+	{
+		terminal_println("Not enough memory for the memory benchmark");
+		searchArena.used = arenaUsed;
+		return;
+	}
 
-		if(score > maxScore)
+	static const size_t sizes[] = { 64, 4096, MEMBENCH_BUFFER_SIZE };
+	uint8_t useSse2 = memoryUseSse2;
+	for(int sse2 = 0; sse2 <= useSse2; sse2++)
+	{
+		memoryUseSse2 = sse2;
+		for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
 		{
-			// We found a new highest scoring move
-			maxScore = score;
-			maxScoreMove = move;
+			for(size_t j = 0; j < sizeof(memoryBenchmarks) / sizeof(memoryBenchmarks[0]); j++)
+			{
+				const struct MemoryBenchmark* benchmark = &memoryBenchmarks[j];
+				uint32_t megabytesPerSecond = membench_run(benchmark, destination, source, sizes[i]);
+
+				terminal_writestring(benchmark->name);
+				terminal_writestring(sse2 ? " sse2 " : " ");
+				terminal_print_int(sizes[i]);
+				terminal_writestring("MB/s: ");
+				terminal_print_int(megabytesPerSecond);
+
+				serial_writestring("membench ");
+				serial_writestring(benchmark->name);
+				serial_writestring(sse2 ? " sse2 size " : " size ");
+				serial_print_uint(sizes[i]);
+				serial_writestring(" MB/s ");
+				serial_print_uint(megabytesPerSecond);
+				serial_writestring("\n");
+			}
 		}
 	}
+	memoryUseSse2 = useSse2;
 
-	/*terminal_println("---- Best Move ----");
-	terminal_print_int(maxScoreMove->boardXIndex);
-	terminal_print_int(maxScoreMove->boardYIndex);
-	terminal_print_int(maxScoreMove->piece);
-	terminal_print_int(maxScoreMove->pieceXIndex);
-	terminal_print_int(maxScoreMove->pieceYIndex);*/
+	searchArena.used = arenaUsed;
+}
 
-	//terminal_println("---- Best Move Score ----");
-	//terminal_print_int(maxScore);
-	//terminal_print_int(totalCalls);
+// Self-play match, started with the "match" boot option. Engine B plays
+// like engine A unless the boot options say otherwise (see grub.cfg).
+uint8_t runMatch = 0;
+unsigned int matchGames = 100;
+unsigned int matchOpeningPlies = 4;
+unsigned int matchSeed = 1;	// The same openings every boot, so builds can be compared
+struct EngineConfig matchEngines[2] =
+{
+	{ "A", 6, 0xFFFFFFFF, 0, 1, 1, 0, 1, 1, 0, 1024 * 1024 },
+	{ "B", 6, 0xFFFFFFFF, 0, 1, 1, 0, 1, 1, 0, 1024 * 1024 }
+};
 
-	totalCallsInGame += totalCalls;
+void run_match()
+{
+	// The results go to the serial port, the screen only shows progress
+	terminal_println("Playing a match, the results go to the serial port");
 
-	// Do the best scoring move.
-	do_move(&game, maxScoreMove);
+	struct MatchResult result;
+	match_play(&matchEngines[0], &matchEngines[1], matchGames, matchOpeningPlies, matchSeed, serial_writestring, &result);
+	match_write_summary(&result, serial_writestring);
 
-	// Store the last made move position. This is used when drawing the game board
-	// to give the last made move piece a slightly lighter color.
-	lastPlayerMoveX = maxScoreMove->boardXIndex * 3 + maxScoreMove->pieceXIndex;
-	lastPlayerMoveY = maxScoreMove->boardYIndex * 3 + maxScoreMove->pieceYIndex;
+	terminal_writestring("Games: ");
+	terminal_print_int(result.games);
+	terminal_writestring("Score of A in %: ");
+	terminal_print_int(result.games ? (result.wins * 2 + result.draws) * 50 / result.games : 0);
 }
  
-#if defined(__cplusplus)
-extern "C" /* Use C linkage for kernel_main. */
-#endif
-void kernel_main()
+// Cursor position on the game board and the keys that are held down
+int cursorX = 0;
+int cursorY = 0;
+int enterPressed = 0;
+int leftPressed = 0;
+int rightPressed = 0;
+int upPressed = 0;
+int downPressed = 0;
+
+int gameResolved = 0;
+
+void keyboard_initialize()
 {
-	terminal_initialize();
-
-	// Store the size of the various structs
-	// for easy access later.
-	struct Move dummyMove;
-	struct Board dummyBoard;
-	struct Game dummyGame;
-
-	moveSizeBytes = sizeof(dummyMove);
-	boardSizeBytes = sizeof(dummyBoard);
-	gameSizeBytes = sizeof(dummyGame);
-
-	/*game_buffer = GAME_BUFFER;
-
-	struct Game testGame1;
-	testGame1.boards[2].emptyPieceCount = 5;
-
-	struct Game* copiedTestGame1 = copy_game(&testGame1);
-
-	terminal_print_int(testGame1.boards[2].emptyPieceCount);
-	terminal_print_int(copiedTestGame1->boards[2].emptyPieceCount);
-
-	terminal_println("---- Test 2 ----");
-
-	uint8_t* ptr = (uint8_t*)(900 * 1024 * 1024);
-	ptr[0] = 128;
-
-	terminal_print_int(ptr[0]);
-
-	return;*/
-
 	char hexStr[] = "000";
 
 	// Set keyboard scan code to 2
@@ -1090,10 +1921,6 @@ void kernel_main()
 	byteToHexString(result, hexStr);
 	//terminal_println(hexStr);
 
-	int cursorX = 0;
-	int cursorY = 0;
-	terminal_setcursor(cursorX, cursorY);
-
 	outb(0x60, 0xF0);
 	outb(0x60, 0);
 	result = inb(0x60);
@@ -1110,152 +1937,157 @@ void kernel_main()
 	}
 	//else
 	//	terminal_println("Failed to get scancode of keyboard");
+}
 
-	//terminal_print_int(moveSizeBytes);
-	//terminal_print_int(boardSizeBytes);
-	//terminal_print_int(gameSizeBytes);
-
-	reset_game();
-
-	draw_game();
-
-	int enterPressed = 0;
-	int leftPressed = 0;
-	int rightPressed = 0;
-	int upPressed = 0;
-	int downPressed = 0;
+void handle_key(uint8_t key)
+{
+	char hexStr[] = "000";
 
-	int gameResolved = 0;
-	while(1)
+	// Check if a valid key was pressed
+	switch(key)
 	{
-		unsigned char key = inb(0x60);
+	case(0x48):
+		if(upPressed || computerVScomputer)
+			break;
 
-		// Check if a valid key was pressed
-		switch(key)
+		upPressed = 1;
+		if(cursorY >= 1)
 		{
-		case(0x48):
-			if(upPressed || computerVScomputer)
-				break;
-
-			upPressed = 1;
-			if(cursorY >= 1)
-			{
-				cursorY--;
-				if(cursorY == 3)
-					cursorY = 2;
-				else if(cursorY == 7)
-					cursorY = 6;
-			}
-			break;
-		case(0xC8):
-			upPressed = 0;
+			cursorY--;
+			if(cursorY == 3)
+				cursorY = 2;
+			else if(cursorY == 7)
+				cursorY = 6;
+		}
+		break;
+	case(0xC8):
+		upPressed = 0;
+		break;
+	case(0x4D):
+		if(rightPressed || computerVScomputer)
 			break;
-		case(0x4D):
-			if(rightPressed || computerVScomputer)
-				break;
 
-			rightPressed = 1;
-			if(cursorX < 10)
-			{
-				cursorX++;
-				if(cursorX == 3)
-					cursorX = 4;
-				else if(cursorX == 7)
-					cursorX = 8;
-			}
-			break;
-		case(0xCD):
-			rightPressed = 0;
+		rightPressed = 1;
+		if(cursorX < 10)
+		{
+			cursorX++;
+			if(cursorX == 3)
+				cursorX = 4;
+			else if(cursorX == 7)
+				cursorX = 8;
+		}
+		break;
+	case(0xCD):
+		rightPressed = 0;
+		break;
+	case(0x50):
+		if(downPressed || computerVScomputer)
 			break;
-		case(0x50):
-			if(downPressed || computerVScomputer)
-				break;
 
-			downPressed = 1;
-			if(cursorY < 10)
-			{
-				cursorY++;
-				if(cursorY == 3)
-					cursorY = 4;
-				else if(cursorY == 7)
-					cursorY = 8;
-			}
-			break;
-		case(0xD0):
-			downPressed = 0;
+		downPressed = 1;
+		if(cursorY < 10)
+		{
+			cursorY++;
+			if(cursorY == 3)
+				cursorY = 4;
+			else if(cursorY == 7)
+				cursorY = 8;
+		}
+		break;
+	case(0xD0):
+		downPressed = 0;
+		break;
+	case(0x4B):
+		if(leftPressed || computerVScomputer)
 			break;
-		case(0x4B):
-			if(leftPressed || computerVScomputer)
-				break;
 
-			leftPressed = 1;
-			if(cursorX >= 1)
-			{
-				cursorX--;
-				if(cursorX == 3)
-					cursorX = 2;
-				else if(cursorX == 7)
-					cursorX = 6;
-			}
-			break;
-		case(0xCB):
-			leftPressed = 0;
+		leftPressed = 1;
+		if(cursorX >= 1)
+		{
+			cursorX--;
+			if(cursorX == 3)
+				cursorX = 2;
+			else if(cursorX == 7)
+				cursorX = 6;
+		}
+		break;
+	case(0xCB):
+		leftPressed = 0;
+		break;
+	case(0x1C):
+		// Enter key down
+		if(enterPressed == 1 || gameResolved == 1)
 			break;
-		case(0x1C):
-			// Enter key down
-			if(enterPressed == 1 || gameResolved == 1)
-				break;
 
-			enterPressed = 1;
+		enterPressed = 1;
 
-			if(computerVScomputer)
-			{
-				do_mini_max();
-				draw_game();
+		if(computerVScomputer)
+		{
+			do_mini_max();
+			draw_game();
 
-				enum board_piece winningPlayer = get_winning_player(&game);
-				if(winningPlayer != UNDECIDED)
+			enum board_state winningPlayer = get_winning_player(&game);
+			if(winningPlayer != UNDECIDED)
+			{
+				if(winningPlayer == PLAYER1_WIN)
+					terminal_println("Player 'X' has won");
+				else if(winningPlayer == PLAYER2_WIN)
+					terminal_println("Player 'O' has won!");
+				else
+					terminal_println("It's a draw!");
+				//terminal_print_int(totalCallsInGame);
+				gameResolved = 1;
+			}
+		}
+		else
+		{
+			if(game.curPlayer == PLAYER1)
+			{
+				struct Move move;
+				move.boardXIndex = cursorX / 4;
+				move.boardYIndex = cursorY / 4;
+				move.piece = PLAYER1;
+				move.pieceXIndex = cursorX % 4;
+				move.pieceYIndex = cursorY % 4;
+
+				if(is_valid_move(&game, &move))
 				{
-					if(winningPlayer == PLAYER1)
-						terminal_println("Player 'X' has won");
-					else if(winningPlayer == PLAYER2)
-						terminal_println("Player 'O' has won!");
-					else
-						terminal_println("It's a draw!");
-					//terminal_print_int(totalCallsInGame);
-					gameResolved = 1;
+					do_move(&game, &move);
+
+					lastPlayerMoveX = move.boardXIndex * 3 + move.pieceXIndex;
+					lastPlayerMoveY = move.boardYIndex * 3 + move.pieceYIndex;
+
+					draw_game();
 				}
+				else
+					break;
+			}
+
+			enum board_state winningPlayer = get_winning_player(&game);
+			if(winningPlayer != UNDECIDED)
+			{
+				if(winningPlayer == PLAYER1_WIN)
+					terminal_println("Player 'X' has won");
+				else if(winningPlayer == PLAYER2_WIN)
+					terminal_println("Player 'O' has won!");
+				else
+					terminal_println("It's a draw!");
+				//terminal_print_int(totalCallsInGame);
+				gameResolved = 1;
 			}
 			else
 			{
-				if(game.curPlayer == PLAYER1)
-				{
-					struct Move move;
-					move.boardXIndex = cursorX / 4;
-					move.boardYIndex = cursorY / 4;
-					move.piece = PLAYER1;
-					move.pieceXIndex = cursorX % 4;
-					move.pieceYIndex = cursorY % 4;
-
-					if(is_valid_move(&game, &move))
-					{
-						do_move(&game, &move);
-
-						lastPlayerMoveX = move.boardXIndex * 3 + move.pieceXIndex;
-						lastPlayerMoveY = move.boardYIndex * 3 + move.pieceYIndex;
-
-						draw_game();
-					}
-					else
-						break;
-				}
+				uint32_t responseStartMs = timer_get_ms();
+				do_mini_max();
+				record_response_time(timer_get_ms() - responseStartMs);
+				draw_game();
 
-				enum board_piece winningPlayer = get_winning_player(&game);
+				enum board_state winningPlayer = get_winning_player(&game);
 				if(winningPlayer != UNDECIDED)
 				{
-					if(winningPlayer == PLAYER1)
+					if(winningPlayer == PLAYER1_WIN)
 						terminal_println("Player 'X' has won");
-					else if(winningPlayer == PLAYER2)
+					else if(winningPlayer == PLAYER2_WIN)
 						terminal_println("Player 'O' has won!");
 					else
 						terminal_println("It's a draw!");
@@ -1263,37 +2095,215 @@ void kernel_main()
 					gameResolved = 1;
 				}
 				else
-				{
-					do_mini_max();
-					draw_game();
-
-					enum board_piece winningPlayer = get_winning_player(&game);
-					if(winningPlayer != UNDECIDED)
-					{
-						if(winningPlayer == PLAYER1)
-							terminal_println("Player 'X' has won");
-						else if(winningPlayer == PLAYER2)
-							terminal_println("Player 'O' has won!");
-						else
-							terminal_println("It's a draw!");
-						//terminal_print_int(totalCallsInGame);
-						gameResolved = 1;
-					}
-				}
+					ponder_start();
 			}
-			break;
-		case(0x9C):
-			// Enter key up
-			enterPressed = 0;
-			break;
-		default:
-			byteToHexString(key, hexStr);
+		}
+		break;
+	case(0x9C):
+		// Enter key up
+		enterPressed = 0;
+		break;
+	default:
+		byteToHexString(key, hexStr);
+
+		//terminal_println(hexStr);
+		break;
+	}
 
-			//terminal_println(hexStr);
+
+	terminal_setcursor(cursorX + GAME_BOARD_X_OFFSET, cursorY + GAME_BOARD_Y_OFFSET);
+}
+
+int option_equals(const char* word, size_t length, const char* option)
+{
+	return length == strlen(option) && bytes_equal(word, option, length);
+}
+int option_value(const char* word, size_t length, const char* option, unsigned int* value)
+{
+	// Options with a number, like "games=200"
+	size_t optionLength = strlen(option);
+	if(length <= optionLength || !bytes_equal(word, option, optionLength))
+		return 0;
+
+	unsigned int number = 0;
+	for(size_t i = optionLength; i < length; i++)
+	{
+		if(word[i] < '0' || word[i] > '9')
+			return 0;
+		number = number * 10 + word[i] - '0';
+	}
+
+	*value = number;
+	return 1;
+}
+void parse_boot_options(struct MultibootInfo* info)
+{
+	// The boot loader passes the path of the kernel followed by the options
+	// from the menu entry, separated by spaces (see grub.cfg).
+	if(!(info->flags & MULTIBOOT_INFO_CMDLINE))
+		return;
+
+	const char* word = (const char*)info->cmdline;
+	int isPath = 1;
+	unsigned int value;
+	while(*word)
+	{
+		size_t length = 0;
+		while(word[length] && word[length] != ' ')
+			length++;
+
+		if(length > 0 && !isPath)
+		{
+			if(option_equals(word, length, "perft"))
+				runPerft = 1;
+			else if(option_equals(word, length, "bench"))
+				runSmpBenchmark = 1;
+			else if(option_equals(word, length, "cvc"))
+				computerVScomputer = 1;
+			else if(option_equals(word, length, "noponder"))
+				ponderEnabled = 0;
+			else if(option_equals(word, length, "nobook"))
+				bookEnabled = 0;
+			else if(option_equals(word, length, "stats"))
+				showSearchStats = 1;
+			else if(option_equals(word, length, "match"))
+				runMatch = 1;
+			else if(option_equals(word, length, "membench"))
+				runMemoryBenchmark = 1;
+			else if(option_value(word, length, "games=", &value))
+				matchGames = value;
+			else if(option_value(word, length, "openingplies=", &value))
+				matchOpeningPlies = value;
+			else if(option_value(word, length, "seed=", &value))
+				matchSeed = value;
+			else if(option_value(word, length, "depth=", &value) && value > 0 && value <= MAX_SEARCH_DEPTH)
+				matchEngines[0].maxDepth = matchEngines[1].maxDepth = value;
+			else if(option_value(word, length, "depth2=", &value) && value > 0 && value <= MAX_SEARCH_DEPTH)
+				matchEngines[1].maxDepth = value;
+			else if(option_value(word, length, "nodes=", &value))
+				matchEngines[0].nodes = matchEngines[1].nodes = value;
+			else if(option_value(word, length, "nodes2=", &value))
+				matchEngines[1].nodes = value;
+			else if(option_equals(word, length, "noordering2"))
+				matchEngines[1].useMoveOrdering = 0;
+			else if(option_equals(word, length, "nomacroeval2"))
+				matchEngines[1].useMacroEval = 0;
+			else if(option_equals(word, length, "simdeval") && sseEnabled)
+				useSimdEval = matchEngines[0].useSimdEval = matchEngines[1].useSimdEval = 1;
+			else if(option_equals(word, length, "simdeval2") && sseEnabled)
+				matchEngines[1].useSimdEval = 1;
+			else if(option_equals(word, length, "nosolver"))
+				useSolver = matchEngines[0].useSolver = matchEngines[1].useSolver = 0;
+			else if(option_equals(word, length, "nosolver2"))
+				matchEngines[1].useSolver = 0;
+			else if(option_equals(word, length, "nopvs"))
+				usePvs = matchEngines[0].usePvs = matchEngines[1].usePvs = 0;
+			else if(option_equals(word, length, "nopvs2"))
+				matchEngines[1].usePvs = 0;
+			else if(option_equals(word, length, "mcts"))
+				useMcts = matchEngines[0].useMcts = matchEngines[1].useMcts = 1;
+			else if(option_equals(word, length, "mcts2"))
+				matchEngines[1].useMcts = 1;
+		}
+		if(length > 0)
+			isPath = 0;
+
+		word += length;
+		while(*word == ' ')
+			word++;
+	}
+}
+void wait_for_key()
+{
+	uint8_t key;
+	while(1)
+	{
+		asm volatile ( "cli" );
+		if(keyboard_read(&key))
 			break;
+		asm volatile ( "sti; hlt" );
+	}
+	asm volatile ( "sti" );
+}
+
+char serialCommand[SERIAL_LINE_SIZE];
+
+#if defined(__cplusplus)
+extern "C" /* Use C linkage for kernel_main. */
+#endif
+void kernel_main(uint32_t multibootMagic, struct MultibootInfo* multibootInfo)
+{
+	// boot.s has enabled SSE if the CPU has SSE2
+	memoryUseSse2 = sseEnabled;
+	terminal_initialize();
+	serial_initialize();
+	keyboard_initialize();
+	pit_initialize();
+	interrupts_initialize();
+	pmm_initialize(multibootMagic, multibootInfo);
+	parse_boot_options(multibootInfo);
+	book_initialize(multibootInfo);
+	search_memory_initialize();
+	search_initialize();
+	protocol_initialize();
+	smp_initialize();
+	tt_initialize();
+
+	if(runPerft)
+		run_perft_suite();
+	if(runSmpBenchmark)
+		run_smp_benchmark();
+	if(runMatch)
+		run_match();
+	if(runMemoryBenchmark)
+		run_memory_benchmark();
+	if(runPerft || runSmpBenchmark || runMatch || runMemoryBenchmark)
+	{
+		terminal_println("Press a key to start the game");
+		wait_for_key();
+	}
+
+	terminal_setcursor(cursorX, cursorY);
+
+	reset_game(&game);
+
+	draw_game();
+
+	while(1)
+	{
+		// Use the time the player is thinking, until a key or a command
+		// comes in
+		if(ponderPending && !keyboard_has_key() && !serial_has_line())
+		{
+			ponder();
+			continue;
 		}
 
-		terminal_setcursor(cursorX + GAME_BOARD_X_OFFSET, cursorY + GAME_BOARD_Y_OFFSET);
+		// Sleep until the next interrupt when there is no key or command to
+		// handle. sti only takes effect after the next instruction, so
+		// nothing can come in between the check and the hlt.
+		uint8_t key;
+		asm volatile ( "cli" );
+		if(keyboard_read(&key))
+		{
+			asm volatile ( "sti" );
+			handle_key(key);
+		}
+		else if(serial_read_line(serialCommand))
+		{
+			asm volatile ( "sti" );
+			if(protocol_line_stops_search(serialCommand, strlen(serialCommand)))
+				serialStopsHandled++;
+
+			// There's nothing to quit to, "quit" only stops a search
+			protocol_handle_line(serialCommand);
+		}
+		else
+		{
+			// Show whatever was drawn before going to sleep
+			terminal_flush();
+			asm volatile ( "sti; hlt" );
+		}
 	}
 }
 
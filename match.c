@@ -0,0 +1,245 @@
+#include "match.h"
+#include "engine.h"
+#include "mcts.h"
+#include "solver.h"
+
+// Scores are worked out in millionths, so the kernel doesn't need floating point
+#define SCORE_SCALE 1000000
+
+void write_uint(void (*write)(const char* text), uint32_t value)
+{
+	char text[11];
+	int index = 10;
+	text[index] = 0;
+	do
+	{
+		text[--index] = '0' + value % 10;
+		value /= 10;
+	}
+	while(value > 0);
+
+	write(&text[index]);
+}
+void write_int(void (*write)(const char* text), int value)
+{
+	if(value < 0)
+	{
+		write("-");
+		write_uint(write, -(uint32_t)value);
+	}
+	else
+	{
+		write("+");
+		write_uint(write, value);
+	}
+}
+void write_tenths(void (*write)(const char* text), uint32_t tenths)
+{
+	char digit[2] = { '0' + tenths % 10, 0 };
+	write_uint(write, tenths / 10);
+	write(".");
+	write(digit);
+}
+
+void random_opening(struct Game* game, unsigned int plies, uint32_t* randomState)
+{
+	reset_game(game);
+
+	struct MoveList moveList;
+	for(unsigned int i = 0; i < plies && get_winning_player(game) == UNDECIDED; i++)
+	{
+		put_moves_for_game(game, &moveList);
+		do_move(game, &moveList.moves[next_random(randomState) % moveList.count]);
+	}
+}
+
+uint8_t search_with_config(const struct EngineConfig* config, struct Game* game)
+{
+	// Every move is searched with an empty transposition table. The engines
+	// don't profit from each other's searches then, and with a fixed depth
+	// the games are the same every time, so a change that should only make
+	// the engine faster must give the exact same results. Clearing takes
+	// time, so keep the table small.
+	useMoveOrdering = config->useMoveOrdering;
+	useMacroEval = config->useMacroEval;
+	useSimdEval = config->useSimdEval;
+	useSolver = config->useSolver;
+	usePvs = config->usePvs;
+	useMcts = config->useMcts;
+	searchNodeLimit = config->nodes;
+	tt_limit_size(config->ttSize);
+
+	int score;
+	return search_game(game, config->maxDepth, config->moveTimeMs, &score);
+}
+
+void match_play(const struct EngineConfig* engineA, const struct EngineConfig* engineB, unsigned int games, unsigned int openingPlies, uint32_t seed, void (*write)(const char* text), struct MatchResult* result)
+{
+	uint8_t savedMoveOrdering = useMoveOrdering;
+	uint8_t savedMacroEval = useMacroEval;
+	uint8_t savedSimdEval = useSimdEval;
+	uint8_t savedSolver = useSolver;
+	uint8_t savedPvs = usePvs;
+	uint8_t savedMcts = useMcts;
+	unsigned int savedNodeLimit = searchNodeLimit;
+
+	result->games = 0;
+	result->wins = 0;
+	result->draws = 0;
+	result->losses = 0;
+
+	uint32_t randomState = seed ? seed : 1;
+	uint32_t startMs = timer_get_ms();
+
+	struct Game opening;
+	for(unsigned int i = 0; i < games; i++)
+	{
+		// Play every opening with both colors
+		int engineAStarts = i % 2 == 0;
+		if(engineAStarts)
+			random_opening(&opening, openingPlies, &randomState);
+
+		struct Game game = opening;
+		unsigned int plies = 0;
+		while(get_winning_player(&game) == UNDECIDED)
+		{
+			int engineAToMove = (game.curPlayer == PLAYER1) == engineAStarts;
+			uint8_t cell = search_with_config(engineAToMove ? engineA : engineB, &game);
+
+			struct Move move;
+			get_move_from_cell(&move, cell, game.curPlayer);
+			do_move(&game, &move);
+			plies++;
+		}
+
+		enum board_state winner = get_winning_player(&game);
+		result->games++;
+		if(winner == DRAW)
+			result->draws++;
+		else if((winner == PLAYER1_WIN) == engineAStarts)
+			result->wins++;
+		else
+			result->losses++;
+
+		write("Game ");
+		write_uint(write, i + 1);
+		write(": ");
+		write(engineAStarts ? engineA->name : engineB->name);
+		write(" - ");
+		write(engineAStarts ? engineB->name : engineA->name);
+		write(winner == PLAYER1_WIN ? " 1-0" : winner == PLAYER2_WIN ? " 0-1" : " 1/2-1/2");
+		write(" in ");
+		write_uint(write, plies);
+		write(" moves, ");
+		write(engineA->name);
+		write(" +");
+		write_uint(write, result->wins);
+		write(" =");
+		write_uint(write, result->draws);
+		write(" -");
+		write_uint(write, result->losses);
+		write("\n");
+	}
+
+	result->timeMs = timer_get_ms() - startMs;
+
+	useMoveOrdering = savedMoveOrdering;
+	useMacroEval = savedMacroEval;
+	useSimdEval = savedSimdEval;
+	useSolver = savedSolver;
+	usePvs = savedPvs;
+	useMcts = savedMcts;
+	searchNodeLimit = savedNodeLimit;
+	tt_limit_size(0);
+}
+
+int32_t log2_fixed(uint32_t x)
+{
+	// log2 of x > 0 with 16 fraction bits. The integer part comes from the
+	// highest set bit, the fraction is worked out one bit at a time by
+	// squaring the rest.
+	int integerPart = 31 - __builtin_clz(x);
+	uint64_t y = ((uint64_t)x << 16) >> integerPart;	// x / 2^integerPart, in [1, 2)
+
+	int32_t result = integerPart << 16;
+	for(int32_t bit = 1 << 15; bit > 0; bit >>= 1)
+	{
+		y = y * y >> 16;
+		if(y >= 2 << 16)
+		{
+			y >>= 1;
+			result += bit;
+		}
+	}
+	return result;
+}
+int elo_from_score(uint32_t score)
+{
+	// The logistic Elo model: score = 1 / (1 + 10^(-elo / 400)), so
+	// elo = 400 * log10(score / (1 - score)). 217706 is log2(10) with 16
+	// fraction bits.
+	int64_t log2Ratio = log2_fixed(score) - log2_fixed(SCORE_SCALE - score);
+	return (int)(log2Ratio * 400 / 217706);
+}
+int match_elo(const struct MatchResult* result, int* elo, int* margin)
+{
+	uint64_t games = result->games;
+	if(games == 0)
+		return 0;
+
+	// Average score per game and its standard error
+	uint32_t score = (uint32_t)(((uint64_t)result->wins * 2 + result->draws) * SCORE_SCALE / (games * 2));
+	if(score == 0 || score == SCORE_SCALE)
+		return 0;
+
+	int64_t winDeviation = SCORE_SCALE - (int64_t)score;
+	int64_t drawDeviation = SCORE_SCALE / 2 - (int64_t)score;
+	int64_t lossDeviation = -(int64_t)score;
+	uint64_t variance = (result->wins * winDeviation * winDeviation + result->draws * drawDeviation * drawDeviation + result->losses * lossDeviation * lossDeviation) / games;
+	uint32_t standardError = isqrt(variance / games);
+
+	*elo = elo_from_score(score);
+
+	// 95% of the results lie within 1.96 standard errors
+	uint32_t scoreMargin = (uint64_t)standardError * 196 / 100;
+	if(scoreMargin >= score || score + scoreMargin >= SCORE_SCALE)
+		*margin = -1;
+	else
+		*margin = (elo_from_score(score + scoreMargin) - elo_from_score(score - scoreMargin)) / 2;
+	return 1;
+}
+
+void match_write_summary(const struct MatchResult* result, void (*write)(const char* text))
+{
+	write("Games: ");
+	write_uint(write, result->games);
+	write("\nWins: ");
+	write_uint(write, result->wins);
+	write("\nDraws: ");
+	write_uint(write, result->draws);
+	write("\nLosses: ");
+	write_uint(write, result->losses);
+
+	write("\nScore %: ");
+	uint32_t pointsTimesTwo = result->wins * 2 + result->draws;
+	write_tenths(write, result->games ? (uint64_t)pointsTimesTwo * 500 / result->games : 0);
+
+	int elo;
+	int margin;
+	write("\nElo: ");
+	if(match_elo(result, &elo, &margin))
+	{
+		write_int(write, elo);
+		write(" +/- ");
+		if(margin >= 0)
+			write_uint(write, margin);
+		else
+			write("inf");
+	}
+	else
+		write(result->games == 0 ? "none" : result->wins ? "+inf" : "-inf");
+
+	write("\nGames/min: ");
+	write_tenths(write, result->timeMs ? (uint64_t)result->games * 600000 / result->timeMs : 0);
+	write("\n");
+}
@@ -0,0 +1,50 @@
+#ifndef MATCH_H
+#define MATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Self-play matches between two engine configurations, to see if a change
+   makes the engine stronger or weaker, or, for a change that should only
+   make it faster, that it plays exactly the same. Only depends on the
+   engine, the kernel and the hosted command line tool both run it. */
+
+struct EngineConfig
+{
+	const char* name;
+	size_t maxDepth;
+	uint32_t moveTimeMs;	// 0xFFFFFFFF for no time limit
+	unsigned int nodes;		// 0 for no node limit
+	uint8_t useMoveOrdering;
+	uint8_t useMacroEval;
+	uint8_t useSimdEval;	// Only when the CPU has SSE2, see evaluate_game_simd
+	uint8_t useSolver;
+	uint8_t usePvs;
+	uint8_t useMcts;		// Monte Carlo search instead of alpha-beta, see mcts.h
+	size_t ttSize;			// Transposition table size in bytes, 0 for all memory
+};
+
+struct MatchResult
+{
+	// Seen from engine A
+	unsigned int games;
+	unsigned int wins;
+	unsigned int draws;
+	unsigned int losses;
+	uint32_t timeMs;
+};
+
+// Plays games between engine A and engine B. Every opening of openingPlies
+// random moves is played twice, with each engine starting once. The
+// openings only depend on the seed. After every game a line is written with
+// write, and a summary at the end.
+void match_play(const struct EngineConfig* engineA, const struct EngineConfig* engineB, unsigned int games, unsigned int openingPlies, uint32_t seed, void (*write)(const char* text), struct MatchResult* result);
+
+// Elo difference of engine A over engine B with the 95% confidence margin.
+// Returns 0 when the score is 0% or 100%, there is no finite estimate then.
+// The margin is -1 when the confidence interval reaches 0% or 100%.
+int match_elo(const struct MatchResult* result, int* elo, int* margin);
+
+void match_write_summary(const struct MatchResult* result, void (*write)(const char* text));
+
+#endif
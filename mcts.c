@@ -0,0 +1,340 @@
+#include "mcts.h"
+
+struct MctsNode
+{
+	uint32_t firstChild;	// Index of the first child, 0 until the node is expanded
+	uint32_t visits;
+	uint32_t score;			// Results of the playouts through the node for the player who moved to it, 2 for a win and 1 for a draw
+	uint8_t childCount;
+	uint8_t cell;			// The move from the parent to this node
+};
+
+// The nodes that are kept when the tree moves down to a new root, one bit
+// per node, and how many nodes before these 32 are kept. Only used while
+// the tree is moved.
+struct MctsMarks
+{
+	uint32_t bits;
+	uint32_t keptBefore;
+};
+
+// The tree: node 0 is the root, the children of a node are taken from the
+// memory in one block. Nothing is given back until the tree moves down.
+struct MctsNode* mctsNodes = 0;
+struct MctsMarks* mctsMarks = 0;
+uint32_t mctsNodeCount = 0;
+uint32_t mctsNodesUsed = 0;		// 0 when there is no tree
+struct Game mctsRootGame;		// The position of the root
+
+uint32_t mctsRandomState = 1;
+
+uint8_t useMcts = 0;
+
+#define MCTS_NO_NODE 0xFFFFFFFF
+
+// The exploration constant of UCT with 16 fraction bits. Larger values try
+// the moves more evenly, smaller ones look deeper at the moves that win.
+#define MCTS_EXPLORATION 30000
+
+// 1 / sqrt(n) with 16 fraction bits for the visits of the children, larger
+// numbers are divided by 4 until they fit
+#define MCTS_SQRT_TABLE_SIZE 1024
+uint32_t mctsInverseSqrt[MCTS_SQRT_TABLE_SIZE];
+
+// Playouts between the checks of stop
+#define MCTS_STOP_INTERVAL 64
+
+uint32_t mcts_log(uint32_t x)
+{
+	// ln x of x > 0 with 16 fraction bits. The fraction of log2 is taken to
+	// be linear between powers of two, which is close enough for UCT.
+	// 45426 is ln 2 with 16 fraction bits.
+	int integerPart = 31 - __builtin_clz(x);
+	uint32_t fraction = (uint32_t)(((uint64_t)x << 16 >> integerPart) - (1 << 16));
+	return (uint32_t)((((uint64_t)integerPart << 16) + fraction) * 45426 >> 16);
+}
+static inline uint32_t mcts_inverse_sqrt(uint32_t x)
+{
+	int shift = 0;
+	while(x >= MCTS_SQRT_TABLE_SIZE)
+	{
+		x >>= 2;
+		shift++;
+	}
+	return mctsInverseSqrt[x] >> shift;
+}
+
+int mcts_set_memory(void* memory, size_t size)
+{
+	// Every 32 nodes need one set of marks behind all of the nodes
+	size_t blockCount = size / (32 * sizeof(struct MctsNode) + sizeof(struct MctsMarks));
+	if(blockCount < 32)
+		return 0;
+
+	mctsNodes = memory;
+	mctsNodeCount = blockCount * 32;
+	mctsMarks = (struct MctsMarks*)(mctsNodes + mctsNodeCount);
+
+	for(uint32_t i = 1; i < MCTS_SQRT_TABLE_SIZE; i++)
+		mctsInverseSqrt[i] = (uint32_t)(((uint64_t)1 << 32) / isqrt((uint64_t)i << 32));
+
+	mcts_clear();
+	return 1;
+}
+size_t mcts_memory_size()
+{
+	return mctsNodeCount * sizeof(struct MctsNode) + mctsNodeCount / 32 * sizeof(struct MctsMarks);
+}
+void mcts_clear()
+{
+	mctsNodesUsed = 0;
+	mctsRandomState = 1;
+}
+
+uint32_t mcts_find_position(struct Game* game)
+{
+	// Returns the node of the position if the tree has it at the root or up
+	// to two moves below it
+	if(mctsNodesUsed == 0)
+		return MCTS_NO_NODE;
+	if(mctsRootGame.hash == game->hash)
+		return 0;
+
+	struct MctsNode* root = &mctsNodes[0];
+	for(uint32_t i = root->firstChild; i < root->firstChild + root->childCount; i++)
+	{
+		struct Game child = mctsRootGame;
+		play_cell(&child, mctsNodes[i].cell);
+		if(child.hash == game->hash)
+			return i;
+
+		struct MctsNode* node = &mctsNodes[i];
+		for(uint32_t j = node->firstChild; j < node->firstChild + node->childCount; j++)
+		{
+			struct Game grandChild = child;
+			play_cell(&grandChild, mctsNodes[j].cell);
+			if(grandChild.hash == game->hash)
+				return j;
+		}
+	}
+	return MCTS_NO_NODE;
+}
+
+static inline int mcts_is_marked(uint32_t index)
+{
+	return (mctsMarks[index / 32].bits >> (index % 32)) & 1;
+}
+static inline uint32_t mcts_kept_index(uint32_t index)
+{
+	// The kept nodes stay in the same order, so a node moves to the number
+	// of kept nodes before it
+	struct MctsMarks* marks = &mctsMarks[index / 32];
+	return marks->keptBefore + __builtin_popcount(marks->bits & ((1u << (index % 32)) - 1));
+}
+void mcts_keep_subtree(uint32_t index)
+{
+	// Makes the node the root and drops the rest of the tree. The nodes
+	// below it are marked and then moved down over the ones that are
+	// dropped. Children always come after their parent, so one pass over
+	// the nodes finds them all, and a node is never moved onto one that
+	// still has to be moved.
+	if(index == 0)
+		return;
+
+	uint32_t blockCount = (mctsNodesUsed + 31) / 32;
+	for(uint32_t i = 0; i < blockCount; i++)
+		mctsMarks[i].bits = 0;
+
+	mctsMarks[index / 32].bits |= 1u << (index % 32);
+	for(uint32_t i = index; i < mctsNodesUsed; i++)
+	{
+		struct MctsNode* node = &mctsNodes[i];
+		if(!mcts_is_marked(i))
+			continue;
+
+		for(uint32_t j = node->firstChild; j < node->firstChild + node->childCount; j++)
+			mctsMarks[j / 32].bits |= 1u << (j % 32);
+	}
+
+	uint32_t kept = 0;
+	for(uint32_t i = 0; i < blockCount; i++)
+	{
+		mctsMarks[i].keptBefore = kept;
+		kept += __builtin_popcount(mctsMarks[i].bits);
+	}
+
+	for(uint32_t i = index; i < mctsNodesUsed; i++)
+	{
+		if(!mcts_is_marked(i))
+			continue;
+
+		struct MctsNode node = mctsNodes[i];
+		if(node.firstChild)
+			node.firstChild = mcts_kept_index(node.firstChild);
+		mctsNodes[mcts_kept_index(i)] = node;
+	}
+	mctsNodesUsed = kept;
+}
+
+int mcts_expand(uint32_t index, struct Game* game)
+{
+	struct MoveList moveList;
+	put_moves_for_game(game, &moveList);
+	if(moveList.count > mctsNodeCount - mctsNodesUsed)
+		return 0;
+
+	struct MctsNode* node = &mctsNodes[index];
+	node->firstChild = mctsNodesUsed;
+	node->childCount = moveList.count;
+	mctsNodesUsed += moveList.count;
+
+	for(unsigned int i = 0; i < moveList.count; i++)
+	{
+		struct MctsNode* child = &mctsNodes[node->firstChild + i];
+		child->firstChild = 0;
+		child->visits = 0;
+		child->score = 0;
+		child->childCount = 0;
+		child->cell = get_move_cell(&moveList.moves[i]);
+	}
+	return 1;
+}
+uint32_t mcts_select_child(uint32_t index)
+{
+	// UCT: the share of the playouts the move won plus the exploration
+	// constant times sqrt(ln(visits of the node) / visits of the move).
+	// Moves that haven't been played out yet go first.
+	struct MctsNode* node = &mctsNodes[index];
+	uint64_t exploration = 0;
+	if(node->visits > 1)
+		exploration = (uint64_t)MCTS_EXPLORATION * isqrt((uint64_t)mcts_log(node->visits) << 16) >> 16;
+
+	uint32_t best = node->firstChild;
+	uint64_t bestValue = 0;
+	for(uint32_t i = node->firstChild; i < node->firstChild + node->childCount; i++)
+	{
+		struct MctsNode* child = &mctsNodes[i];
+		if(child->visits == 0)
+			return i;
+
+		uint64_t value = ((uint64_t)child->score << 15) / child->visits + (exploration * mcts_inverse_sqrt(child->visits) >> 16);
+		if(value > bestValue)
+		{
+			bestValue = value;
+			best = i;
+		}
+	}
+	return best;
+}
+enum board_state mcts_playout(struct Game* game)
+{
+	// Random moves until the game is over
+	struct MoveList moveList;
+	enum board_state winner;
+	while((winner = get_winning_player(game)) == UNDECIDED)
+	{
+		put_moves_for_game(game, &moveList);
+		uint32_t choice = (uint64_t)next_random(&mctsRandomState) * moveList.count >> 32;
+		do_move(game, &moveList.moves[choice]);
+	}
+	return winner;
+}
+int mcts_iterate(struct Game* rootGame)
+{
+	// Walks down the tree, grows it by the children of the node it ends at
+	// and plays the game out from one of them. The result counts for every
+	// node on the way. Returns the ply the tree was left at.
+	uint32_t path[MAX_MOVES + 2];
+	struct Game game = *rootGame;
+	uint32_t index = 0;
+	int ply = 0;
+
+	path[0] = 0;
+	while(mctsNodes[index].firstChild)
+	{
+		index = mcts_select_child(index);
+		play_cell(&game, mctsNodes[index].cell);
+		path[++ply] = index;
+	}
+
+	enum board_state winner = get_winning_player(&game);
+	if(winner == UNDECIDED)
+	{
+		// Only nodes that have been played out before get children, most
+		// nodes are never visited again. The tree stops growing when the
+		// memory is full.
+		if(mctsNodes[index].visits > 0 && mcts_expand(index, &game))
+		{
+			index = mctsNodes[index].firstChild;
+			play_cell(&game, mctsNodes[index].cell);
+			path[++ply] = index;
+		}
+		winner = mcts_playout(&game);
+	}
+
+	// The player to move at the root moved to the nodes at the odd plies
+	enum board_piece rootPlayer = rootGame->curPlayer;
+	enum board_piece otherPlayer = get_next_player(rootPlayer);
+	for(int i = ply; i >= 0; i--)
+	{
+		struct MctsNode* node = &mctsNodes[path[i]];
+		node->visits++;
+		if(winner == DRAW)
+			node->score += 1;
+		else if(winner == get_winning_state(i % 2 == 1 ? rootPlayer : otherPlayer))
+			node->score += 2;
+	}
+	return ply;
+}
+
+int mcts_search(struct Game* game, struct MctsResult* result, int (*stop)(), int stopWhenFull, unsigned int* nodes)
+{
+	// Go on with the tree of an earlier search if it has the position
+	uint32_t index = mcts_find_position(game);
+	if(index == MCTS_NO_NODE)
+	{
+		struct MctsNode* root = &mctsNodes[0];
+		root->firstChild = 0;
+		root->visits = 0;
+		root->score = 0;
+		root->childCount = 0;
+		root->cell = 0xFF;
+		mctsNodesUsed = 1;
+	}
+	else
+		mcts_keep_subtree(index);
+	mctsRootGame = *game;
+
+	// There is always room for the moves of the root, see mcts_set_memory
+	if(!mctsNodes[0].firstChild)
+		mcts_expand(0, game);
+
+	result->depth = 0;
+	result->playouts = 0;
+	int stopped = 0;
+	while(!stopped)
+	{
+		int ply = mcts_iterate(game);
+		if(ply > result->depth)
+			result->depth = ply;
+		result->playouts++;
+		(*nodes)++;
+
+		if(result->playouts % MCTS_STOP_INTERVAL == 0 && stop())
+			stopped = 1;
+		else if(stopWhenFull && mctsNodesUsed + MAX_MOVES > mctsNodeCount)
+			break;
+	}
+
+	// The move played out most often is the one UCT trusts most
+	struct MctsNode* root = &mctsNodes[0];
+	struct MctsNode* best = &mctsNodes[root->firstChild];
+	for(uint32_t i = root->firstChild + 1; i < root->firstChild + root->childCount; i++)
+	{
+		if(mctsNodes[i].visits > best->visits)
+			best = &mctsNodes[i];
+	}
+	result->cell = best->cell;
+	result->score = best->visits ? (int)((uint64_t)best->score * 1000 / best->visits) - 1000 : 0;
+	return stopped;
+}
@@ -0,0 +1,45 @@
+#ifndef MCTS_H
+#define MCTS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "engine.h"
+
+/* Monte Carlo tree search, the second engine next to the alpha-beta search.
+   Instead of evaluating positions it plays them out to the end with random
+   moves, and grows a tree towards the moves that win the most playouts. The
+   move to try next is picked with UCT: the share of playouts a move won plus
+   a bonus for moves that have been tried little. search_game uses it
+   instead of the alpha-beta search when useMcts is set.
+
+   The tree nodes come from memory the platform provides and refer to their
+   children by index. The tree is kept from one search to the next: when the
+   next search is of a position a move or two further, the part of the tree
+   below that position is moved to the front of the memory and grown on. */
+
+extern uint8_t useMcts;
+
+struct MctsResult
+{
+	uint8_t cell;			// The move that was played out most often
+	int score;				// Expected result for the player to move, from -1000 lost to 1000 won
+	int depth;				// Deepest ply of the tree
+	unsigned int playouts;
+};
+
+// Sets the memory of the tree, returns 0 if it's too small
+int mcts_set_memory(void* memory, size_t size);
+size_t mcts_memory_size();
+
+// Searches an undecided position until stop returns 1, which is checked
+// every so often. With stopWhenFull set it also stops once the tree can't
+// grow any more, for searches that have no time limit. Returns 1 when stop
+// ended the search. Every playout adds one to *nodes.
+int mcts_search(struct Game* game, struct MctsResult* result, int (*stop)(), int stopWhenFull, unsigned int* nodes);
+
+// Forgets the tree and starts the random moves over, so the same searches
+// play out the same way again
+void mcts_clear();
+
+#endif
@@ -0,0 +1,162 @@
+#include "memory.h"
+
+/* Everything is done with string instructions and SSE2 in inline assembly.
+   Written as plain C loops the compiler could turn them back into calls to
+   memcpy and memset. */
+
+uint8_t memoryUseSse2 = 0;
+
+// Below this size the alignment and setup of the SSE2 loops don't pay off
+#define SSE2_MIN_SIZE 512
+
+static inline void copy_bytes(uint8_t** destination, const uint8_t** source, size_t count)
+{
+	asm volatile ( "rep movsb" : "+D"(*destination), "+S"(*source), "+c"(count) : : "memory" );
+}
+static inline void copy_dwords(uint8_t** destination, const uint8_t** source, size_t count)
+{
+	asm volatile ( "rep movsl" : "+D"(*destination), "+S"(*source), "+c"(count) : : "memory" );
+}
+// The kernel is built without SSE, only the functions that use it are
+// compiled for it. They can't be inlined into the others.
+__attribute__((target("sse2"), noinline)) static void copy_blocks_sse2(uint8_t** destination, const uint8_t** source, size_t count)
+{
+	// Copies count blocks of 64 bytes, the destination is 16 byte aligned
+	if(count == 0)
+		return;
+
+	asm volatile (
+		"1:\n\t"
+		"movdqu (%1), %%xmm0\n\t"
+		"movdqu 16(%1), %%xmm1\n\t"
+		"movdqu 32(%1), %%xmm2\n\t"
+		"movdqu 48(%1), %%xmm3\n\t"
+		"movdqa %%xmm0, (%0)\n\t"
+		"movdqa %%xmm1, 16(%0)\n\t"
+		"movdqa %%xmm2, 32(%0)\n\t"
+		"movdqa %%xmm3, 48(%0)\n\t"
+		"add $64, %1\n\t"
+		"add $64, %0\n\t"
+		"dec %2\n\t"
+		"jnz 1b"
+		: "+r"(*destination), "+r"(*source), "+r"(count)
+		:
+		: "xmm0", "xmm1", "xmm2", "xmm3", "memory" );
+}
+
+__attribute__((target("sse2"), noinline)) static void set_blocks_sse2(uint8_t** destination, uint32_t pattern, size_t count)
+{
+	// Fills count blocks of 64 bytes, the destination is 16 byte aligned
+	if(count == 0)
+		return;
+
+	asm volatile (
+		"movd %2, %%xmm0\n\t"
+		"pshufd $0, %%xmm0, %%xmm0\n\t"
+		"1:\n\t"
+		"movdqa %%xmm0, (%0)\n\t"
+		"movdqa %%xmm0, 16(%0)\n\t"
+		"movdqa %%xmm0, 32(%0)\n\t"
+		"movdqa %%xmm0, 48(%0)\n\t"
+		"add $64, %0\n\t"
+		"dec %1\n\t"
+		"jnz 1b"
+		: "+r"(*destination), "+r"(count)
+		: "r"(pattern)
+		: "xmm0", "memory" );
+}
+
+void* memcpy(void* destination, const void* source, size_t size)
+{
+	uint8_t* to = destination;
+	const uint8_t* from = source;
+
+	if(size >= 16)
+	{
+		// Align the destination first, misaligned stores cost more than
+		// misaligned loads
+		if(memoryUseSse2 && size >= SSE2_MIN_SIZE)
+		{
+			size_t head = -(uintptr_t)to & 15;
+			copy_bytes(&to, &from, head);
+			size -= head;
+
+			copy_blocks_sse2(&to, &from, size / 64);
+			size %= 64;
+		}
+		else
+		{
+			size_t head = -(uintptr_t)to & 3;
+			copy_bytes(&to, &from, head);
+			size -= head;
+		}
+
+		copy_dwords(&to, &from, size / 4);
+		size %= 4;
+	}
+
+	copy_bytes(&to, &from, size);
+	return destination;
+}
+
+void* memset(void* destination, int value, size_t size)
+{
+	uint8_t* to = destination;
+	uint32_t pattern = (uint8_t)value * 0x01010101;
+
+	if(size >= 16)
+	{
+		if(memoryUseSse2 && size >= SSE2_MIN_SIZE)
+		{
+			size_t head = -(uintptr_t)to & 15;
+			size -= head;
+			asm volatile ( "rep stosb" : "+D"(to), "+c"(head) : "a"(pattern) : "memory" );
+
+			set_blocks_sse2(&to, pattern, size / 64);
+			size %= 64;
+		}
+		else
+		{
+			size_t head = -(uintptr_t)to & 3;
+			size -= head;
+			asm volatile ( "rep stosb" : "+D"(to), "+c"(head) : "a"(pattern) : "memory" );
+		}
+
+		size_t dwords = size / 4;
+		size %= 4;
+		asm volatile ( "rep stosl" : "+D"(to), "+c"(dwords) : "a"(pattern) : "memory" );
+	}
+
+	asm volatile ( "rep stosb" : "+D"(to), "+c"(size) : "a"(pattern) : "memory" );
+	return destination;
+}
+
+void* memmove(void* destination, const void* source, size_t size)
+{
+	uint8_t* to = destination;
+	const uint8_t* from = source;
+
+	// Copying to the front is safe in any case, every byte is read before
+	// the copy gets to write it
+	if(to <= from || to >= from + size)
+		return memcpy(destination, source, size);
+
+	// Copy back to front with the direction flag set: first the bytes that
+	// don't make up a whole dword at the end, then the dwords
+	to += size - 1;
+	from += size - 1;
+	size_t tail = size % 4;
+	asm volatile ( "std\n\trep movsb\n\tcld" : "+D"(to), "+S"(from), "+c"(tail) : : "memory" );
+
+	to -= 3;
+	from -= 3;
+	size_t dwords = size / 4;
+	asm volatile ( "std\n\trep movsl\n\tcld" : "+D"(to), "+S"(from), "+c"(dwords) : : "memory" );
+
+	return destination;
+}
+
+void memset16(uint16_t* destination, uint16_t value, size_t count)
+{
+	asm volatile ( "rep stosw" : "+D"(destination), "+c"(count) : "a"(value) : "memory" );
+}
@@ -0,0 +1,25 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* memcpy, memset and memmove for the kernel. The compiler calls these on its
+   own as well, for instance to copy a struct, so they have the names and
+   the behavior of the C library. The engine relies on them too, in the
+   hosted build they come from the C library.
+
+   Copies use rep movsd on the aligned middle part. Large blocks use SSE2
+   once memoryUseSse2 is set, which may only be done after SSE has been
+   enabled. */
+
+extern uint8_t memoryUseSse2;
+
+void* memcpy(void* destination, const void* source, size_t size);
+void* memset(void* destination, int value, size_t size);
+void* memmove(void* destination, const void* source, size_t size);
+
+// Fills count 16 bit words, like the cells of the text screen
+void memset16(uint16_t* destination, uint16_t value, size_t count);
+
+#endif
@@ -0,0 +1,259 @@
+#include "protocol.h"
+#include "engine.h"
+
+volatile uint8_t protocolSearching = 0;
+
+// The position the commands work on, separate from any game the platform
+// shows on its own.
+struct Game protocolGame;
+
+const char* next_word(const char* text, const char** word, size_t* length)
+{
+	// Finds the next word separated by spaces or tabs, returns the text after it
+	while(*text == ' ' || *text == '\t')
+		text++;
+
+	*word = text;
+	*length = 0;
+	while(text[*length] && text[*length] != ' ' && text[*length] != '\t')
+		(*length)++;
+
+	return text + *length;
+}
+int word_is(const char* word, size_t length, const char* expected)
+{
+	for(size_t i = 0; i < length; i++)
+	{
+		if(word[i] != expected[i])
+			return 0;
+	}
+	return expected[length] == 0;
+}
+int parse_uint(const char* word, size_t length, uint32_t* result)
+{
+	if(length == 0 || length > 9)
+		return 0;
+
+	uint32_t value = 0;
+	for(size_t i = 0; i < length; i++)
+	{
+		if(word[i] < '0' || word[i] > '9')
+			return 0;
+		value = value * 10 + word[i] - '0';
+	}
+
+	*result = value;
+	return 1;
+}
+
+void protocol_write_uint(uint32_t value)
+{
+	char text[11];
+	int index = 10;
+	text[index] = 0;
+	do
+	{
+		text[--index] = '0' + value % 10;
+		value /= 10;
+	}
+	while(value > 0);
+
+	protocol_write(&text[index]);
+}
+void protocol_write_int(int value)
+{
+	if(value < 0)
+	{
+		protocol_write("-");
+		protocol_write_uint(-(uint32_t)value);
+	}
+	else
+		protocol_write_uint(value);
+}
+
+void protocol_initialize()
+{
+	reset_game(&protocolGame);
+}
+
+void handle_position(const char* text)
+{
+	// Set up the position on a copy so a bad command leaves the old one
+	struct Game game;
+	const char* word;
+	size_t length;
+	text = next_word(text, &word, &length);
+
+	if(word_is(word, length, "startpos"))
+		reset_game(&game);
+	else if(word_is(word, length, "cells"))
+	{
+		while(*text == ' ')
+			text++;
+
+		int positionLength = game_from_string(&game, text);
+		if(positionLength < 0)
+		{
+			protocol_write("info string invalid position\n");
+			return;
+		}
+		text += positionLength;
+	}
+	else
+	{
+		protocol_write("info string expected startpos or cells\n");
+		return;
+	}
+
+	text = next_word(text, &word, &length);
+	if(length > 0)
+	{
+		if(!word_is(word, length, "moves") || play_moves(&game, text) < 0)
+		{
+			protocol_write("info string invalid moves\n");
+			return;
+		}
+	}
+
+	protocolGame = game;
+}
+void handle_go(const char* text)
+{
+	uint32_t depth = MAX_SEARCH_DEPTH;
+	uint32_t timeMs = 0xFFFFFFFF;
+	uint32_t nodes = 0;
+
+	const char* word;
+	size_t length;
+	while(1)
+	{
+		text = next_word(text, &word, &length);
+		if(length == 0)
+			break;
+
+		if(word_is(word, length, "infinite"))
+			continue;
+
+		// The other limits all take a number
+		const char* value;
+		size_t valueLength;
+		text = next_word(text, &value, &valueLength);
+
+		uint32_t number;
+		if(!parse_uint(value, valueLength, &number))
+		{
+			protocol_write("info string expected a number\n");
+			return;
+		}
+
+		if(word_is(word, length, "depth"))
+			depth = number;
+		else if(word_is(word, length, "movetime"))
+			timeMs = number;
+		else if(word_is(word, length, "nodes"))
+			nodes = number;
+		else
+		{
+			protocol_write("info string unknown limit\n");
+			return;
+		}
+	}
+
+	if(depth < 1)
+		depth = 1;
+	if(depth > MAX_SEARCH_DEPTH)
+		depth = MAX_SEARCH_DEPTH;
+
+	int score;
+	searchNodeLimit = nodes;
+	protocolSearching = 1;
+	uint8_t cell = search_game(&protocolGame, depth, timeMs, &score);
+	protocolSearching = 0;
+	searchNodeLimit = 0;
+
+	// A game that is over has no move to play
+	if(cell == 0xFF)
+	{
+		protocol_write("bestmove none\n");
+		return;
+	}
+
+	struct SearchStats stats;
+	search_get_stats(&stats);
+
+	char cellText[3];
+	cell_to_string(cell, cellText);
+
+	protocol_write("info depth ");
+	protocol_write_int(stats.depth);
+	protocol_write(" score ");
+	protocol_write_int(score);
+	protocol_write(" nodes ");
+	protocol_write_uint(stats.nodes);
+	protocol_write(" time ");
+	protocol_write_uint(stats.timeMs);
+	protocol_write(" nps ");
+	protocol_write_uint(stats.timeMs ? (uint64_t)stats.nodes * 1000 / stats.timeMs : 0);
+	protocol_write("\nbestmove ");
+	protocol_write(cellText);
+	protocol_write("\n");
+}
+int protocol_line_stops_search(const char* line, size_t length)
+{
+	// The line doesn't need to end in a 0, the platform may still be
+	// collecting the next one behind it.
+	while(length > 0 && (*line == ' ' || *line == '\t'))
+	{
+		line++;
+		length--;
+	}
+	while(length > 0 && (line[length - 1] == ' ' || line[length - 1] == '\t' || line[length - 1] == '\r'))
+		length--;
+
+	return word_is(line, length, "stop") || word_is(line, length, "quit");
+}
+int protocol_handle_line(const char* line)
+{
+	const char* word;
+	size_t length;
+	const char* text = next_word(line, &word, &length);
+
+	if(length == 0)
+		return 1;
+
+	if(word_is(word, length, "uci"))
+		protocol_write("id name TicTacTOS\nuciok\n");
+	else if(word_is(word, length, "isready"))
+		protocol_write("readyok\n");
+	else if(word_is(word, length, "newgame"))
+	{
+		reset_game(&protocolGame);
+		tt_clear();
+	}
+	else if(word_is(word, length, "position"))
+		handle_position(text);
+	else if(word_is(word, length, "go"))
+		handle_go(text);
+	else if(word_is(word, length, "stop"))
+	{
+		// The line that stopped the search has been handled by now
+	}
+	else if(word_is(word, length, "d"))
+	{
+		char position[GAME_STRING_SIZE];
+		game_to_string(&protocolGame, position);
+		protocol_write("position cells ");
+		protocol_write(position);
+		protocol_write("\n");
+	}
+	else if(word_is(word, length, "quit"))
+		return 0;
+	else
+	{
+		protocol_write("info string unknown command: ");
+		protocol_write(line);
+		protocol_write("\n");
+	}
+
+	return 1;
+}
@@ -0,0 +1,43 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A line based text protocol to drive the engine, in the spirit of UCI, so
+   scripts and match managers can play against it. Like the engine it only
+   depends on the compiler: the kernel speaks it on the serial port and the
+   hosted command line tool on stdin and stdout.
+
+   Commands, one per line:
+     uci                     replies with the engine name and "uciok"
+     isready                 replies "readyok"
+     newgame                 starts a new game and clears the transposition table
+     position startpos [moves 55 51 ...]
+     position cells <cells> <x|o> <0-9> [moves ...]
+                             sets the position, see game_from_string
+     go [depth N] [movetime N] [nodes N] [infinite]
+                             searches the position, then replies with an
+                             "info" line and "bestmove <move>"
+     stop                    stops the search
+     d                       prints the position as a "position cells" command
+     quit                    tells the platform to stop
+
+   Moves use the notation of cell_to_string. A search runs until it reaches
+   one of the limits of "go" or a "stop" or "quit" comes in. Other commands
+   that come in while it runs wait until "bestmove" has been sent. */
+
+// Set while "go" is searching. The platform should then make
+// search_poll_stop return non-zero once a line comes in for which
+// protocol_line_stops_search is true.
+extern volatile uint8_t protocolSearching;
+
+void protocol_initialize();
+// Handles one line without the line end. Returns 0 after "quit".
+int protocol_handle_line(const char* line);
+int protocol_line_stops_search(const char* line, size_t length);
+
+// Provided by the platform: writes text to the other side. Lines end in '\n'.
+void protocol_write(const char* text);
+
+#endif
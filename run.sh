@@ -2,5 +2,5 @@
 
 sudo bash build.sh
 
-sudo qemu-system-i386 -m 1G -cdrom build/myos.iso
+sudo qemu-system-i386 -m 32M -smp 4 -serial stdio -cdrom build/myos.iso
 
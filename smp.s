@@ -0,0 +1,49 @@
+# Startup code of the application processors. They start in real mode at the
+# page given in the startup IPI, smp_initialize copies everything between
+# ap_trampoline_start and ap_trampoline_end to AP_TRAMPOLINE_ADDRESS.
+.set AP_TRAMPOLINE_ADDRESS, 0x8000
+
+.section .text
+.code16
+.global ap_trampoline_start
+ap_trampoline_start:
+	cli
+	cld
+	xorw %ax, %ax
+	movw %ax, %ds
+
+	# The code runs at its copy, so address the GDT descriptor there
+	lgdtl AP_TRAMPOLINE_ADDRESS + (ap_gdt_descriptor - ap_trampoline_start)
+
+	# Enable protected mode and jump to the 32 bit code in the kernel image
+	movl %cr0, %eax
+	orl $1, %eax
+	movl %eax, %cr0
+	ljmpl $0x08, $ap_protected_mode
+
+.align 4
+ap_gdt_descriptor:
+.word 3 * 8 - 1                 # the GDT in boot.s has three descriptors
+.long gdt
+
+.global ap_trampoline_end
+ap_trampoline_end:
+
+.code32
+ap_protected_mode:
+	movw $0x10, %ax
+	movw %ax, %ds
+	movw %ax, %es
+	movw %ax, %fs
+	movw %ax, %gs
+	movw %ax, %ss
+
+	# smp_start_cpu puts the top of the stack of this CPU in apBootStack
+	movl apBootStack, %esp
+	call enable_sse
+	call ap_main
+
+	cli
+.Lap_hang:
+	hlt
+	jmp .Lap_hang
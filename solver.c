@@ -0,0 +1,428 @@
+#include "solver.h"
+
+// Proof and disproof numbers: the least number of leaves that have to be
+// proven (or disproven) to prove (or disprove) a node. Infinite for a node
+// that has been disproven (or proven).
+#define PN_INFINITY 0xFFFFFFFF
+
+struct SolverNode
+{
+	uint32_t proof;
+	uint32_t disproof;
+	uint32_t firstChild;	// Pool index of the first child, 0 until the node is expanded
+	uint8_t childCount;
+	uint8_t cell;			// The move from the parent to this node
+};
+
+// The node pool: the children of a node are taken from it in one block,
+// nothing is given back until the next search empties it.
+struct SolverNode* solverPool = 0;
+uint32_t solverPoolSize = 0;
+uint32_t solverPoolUsed = 0;
+
+uint8_t useSolver = 1;
+
+// What the solver tries to prove for the player to move at the root
+enum solver_goal
+{
+	GOAL_WIN,
+	GOAL_NOT_LOSE
+};
+
+struct SolverRun
+{
+	struct Game* root;
+	enum board_piece rootPlayer;
+	enum solver_goal goal;
+	int maxPly;				// The game has to be decided by this ply for a win or a loss
+	int (*stop)();
+	unsigned int* nodes;
+};
+
+// Solved positions by hash, as seen by the player to move there. Entries
+// whose move isn't known have a cell of 0xFF.
+#define SOLVER_CACHE_SIZE 4096
+
+struct SolverCacheEntry
+{
+	uint64_t hash;
+	int8_t value;
+	uint8_t distance;
+	uint8_t cell;
+};
+struct SolverCacheEntry solverCache[SOLVER_CACHE_SIZE];
+
+int solver_set_memory(void* memory, size_t size)
+{
+	if(size < 1024 * sizeof(struct SolverNode))
+		return 0;
+
+	solverPool = memory;
+	solverPoolSize = size / sizeof(struct SolverNode);
+	return 1;
+}
+size_t solver_memory_size()
+{
+	return solverPoolSize * sizeof(struct SolverNode);
+}
+
+void solver_clear()
+{
+	for(size_t i = 0; i < SOLVER_CACHE_SIZE; i++)
+		solverCache[i].hash = 0;
+}
+struct SolverCacheEntry* solver_cache_find(uint64_t hash)
+{
+	struct SolverCacheEntry* entry = &solverCache[hash % SOLVER_CACHE_SIZE];
+	return entry->hash == hash && hash != 0 ? entry : 0;
+}
+void solver_cache_store(uint64_t hash, enum solver_value value, int distance, uint8_t cell)
+{
+	struct SolverCacheEntry* entry = &solverCache[hash % SOLVER_CACHE_SIZE];
+	entry->hash = hash;
+	entry->value = value;
+	entry->distance = distance;
+	entry->cell = cell;
+}
+
+int count_empty_cells(struct Game* game)
+{
+	// Only cells of undecided boards can still be played, so this is the
+	// most plies the game can still last
+	int count = 0;
+	for(int i = 0; i < 9; i++)
+	{
+		if(!(game->decidedBoards & (1 << i)))
+			count += 9 - __builtin_popcount(game->boards[i].pieces[0] | game->boards[i].pieces[1]);
+	}
+	return count;
+}
+int solver_can_solve(struct Game* game)
+{
+	return solverPool && count_empty_cells(game) <= SOLVER_MAX_EMPTY_CELLS;
+}
+
+static inline uint32_t add_numbers(uint32_t a, uint32_t b)
+{
+	return a >= PN_INFINITY - b ? PN_INFINITY : a + b;
+}
+
+void solver_set_leaf(struct SolverRun* run, struct SolverNode* node, struct Game* game, int ply)
+{
+	// A leaf is proven or disproven when the game is over, when it can't be
+	// over in time any more, or when the position has been solved before.
+	// The root is always searched, a move has to come out of it.
+	int rootWins;
+	int rootLoses;
+	int endPly;
+
+	enum board_state winner = get_winning_player(game);
+	struct SolverCacheEntry* entry;
+	if(winner != UNDECIDED)
+	{
+		rootWins = winner == get_winning_state(run->rootPlayer);
+		rootLoses = !rootWins && winner != DRAW;
+		endPly = ply;
+	}
+	else if(ply >= run->maxPly)
+	{
+		rootWins = 0;
+		rootLoses = 0;
+		endPly = ply;
+	}
+	else if(ply > 0 && (entry = solver_cache_find(game->hash)) != 0)
+	{
+		int moverIsRoot = game->curPlayer == run->rootPlayer;
+		rootWins = entry->value != SOLVER_DRAW && (entry->value == SOLVER_WIN) == moverIsRoot;
+		rootLoses = entry->value != SOLVER_DRAW && !rootWins;
+		endPly = ply + entry->distance;
+	}
+	else
+	{
+		node->proof = 1;
+		node->disproof = 1;
+		return;
+	}
+
+	int proven;
+	if(run->goal == GOAL_WIN)
+		proven = rootWins && endPly <= run->maxPly;
+	else
+		proven = !(rootLoses && endPly <= run->maxPly);
+
+	node->proof = proven ? 0 : PN_INFINITY;
+	node->disproof = proven ? PN_INFINITY : 0;
+}
+int solver_expand(struct SolverRun* run, uint32_t index, struct Game* game, int ply)
+{
+	struct MoveList moveList;
+	put_moves_for_game(game, &moveList);
+	if(moveList.count > solverPoolSize - solverPoolUsed)
+		return 0;
+
+	struct SolverNode* node = &solverPool[index];
+	node->firstChild = solverPoolUsed;
+	node->childCount = moveList.count;
+	solverPoolUsed += moveList.count;
+
+	for(unsigned int i = 0; i < moveList.count; i++)
+	{
+		struct SolverNode* child = &solverPool[node->firstChild + i];
+		child->firstChild = 0;
+		child->childCount = 0;
+		child->cell = get_move_cell(&moveList.moves[i]);
+
+		do_move(game, &moveList.moves[i]);
+		solver_set_leaf(run, child, game, ply + 1);
+		undo_move(game, &moveList.moves[i]);
+	}
+	*run->nodes += moveList.count;
+	return 1;
+}
+void solver_update(uint32_t index, int isOrNode)
+{
+	// At an OR node the root player moves, one proven child proves it. At
+	// an AND node the opponent moves, all children have to be proven.
+	struct SolverNode* node = &solverPool[index];
+	uint32_t minimum = PN_INFINITY;
+	uint32_t sum = 0;
+	for(uint32_t i = node->firstChild; i < node->firstChild + node->childCount; i++)
+	{
+		uint32_t minimized = isOrNode ? solverPool[i].proof : solverPool[i].disproof;
+		uint32_t summed = isOrNode ? solverPool[i].disproof : solverPool[i].proof;
+		if(minimized < minimum)
+			minimum = minimized;
+		sum = add_numbers(sum, summed);
+	}
+
+	node->proof = isOrNode ? minimum : sum;
+	node->disproof = isOrNode ? sum : minimum;
+}
+int solver_run(struct SolverRun* run, uint8_t* provingCell)
+{
+	// Returns 1 when the goal has been proven, with the move that proves it
+	// in provingCell, 0 when it has been disproven and -1 when the pool ran
+	// out or the search has to stop.
+	struct SolverNode* root = &solverPool[0];
+	root->firstChild = 0;
+	root->childCount = 0;
+	solverPoolUsed = 1;
+	solver_set_leaf(run, root, run->root, 0);
+
+	// Plies alternate, so the root player moves at the even ones
+	uint32_t path[MAX_MOVES + 1];
+	unsigned int iterations = 0;
+	while(root->proof != 0 && root->disproof != 0)
+	{
+		if(++iterations % 256 == 0 && run->stop())
+			return -1;
+
+		// Walk down to the most proving node: the child with the smallest
+		// proof number where the root player moves, the smallest disproof
+		// number where the opponent moves
+		struct Game game = *run->root;
+		uint32_t index = 0;
+		int ply = 0;
+		while(solverPool[index].firstChild)
+		{
+			struct SolverNode* node = &solverPool[index];
+			uint32_t best = node->firstChild;
+			for(uint32_t i = node->firstChild + 1; i < node->firstChild + node->childCount; i++)
+			{
+				if(ply % 2 == 0 ? solverPool[i].proof < solverPool[best].proof : solverPool[i].disproof < solverPool[best].disproof)
+					best = i;
+			}
+
+			path[ply++] = index;
+			play_cell(&game, solverPool[best].cell);
+			index = best;
+		}
+		path[ply] = index;
+
+		if(!solver_expand(run, index, &game, ply))
+			return -1;
+
+		for(int i = ply; i >= 0; i--)
+			solver_update(path[i], i % 2 == 0);
+	}
+
+	if(root->proof != 0)
+		return 0;
+
+	for(uint32_t i = root->firstChild; i < root->firstChild + root->childCount; i++)
+	{
+		if(solverPool[i].proof == 0)
+		{
+			*provingCell = solverPool[i].cell;
+			break;
+		}
+	}
+	return 1;
+}
+
+int solver_solve(struct Game* game, struct SolverResult* result, int (*stop)(), unsigned int* nodes)
+{
+	struct SolverCacheEntry* entry = solver_cache_find(game->hash);
+	if(entry && entry->cell != 0xFF)
+	{
+		result->value = entry->value;
+		result->distance = entry->distance;
+		result->cell = entry->cell;
+		return 1;
+	}
+
+	// No game lasts longer than the cells that are left
+	int maxPlies = count_empty_cells(game);
+	struct SolverRun run = { game, game->curPlayer, GOAL_WIN, maxPlies, stop, nodes };
+
+	uint8_t cell;
+	int proven = solver_run(&run, &cell);
+	if(proven < 0)
+		return 0;
+
+	if(proven)
+	{
+		// The shortest win: the player to move wins at an odd ply, find the
+		// first bound it can be proven within
+		result->value = SOLVER_WIN;
+		for(int maxPly = 1; maxPly <= maxPlies; maxPly += 2)
+		{
+			run.maxPly = maxPly;
+			proven = solver_run(&run, &cell);
+			if(proven < 0)
+				return 0;
+			if(proven)
+			{
+				result->distance = maxPly;
+				result->cell = cell;
+				break;
+			}
+		}
+	}
+	else
+	{
+		run.goal = GOAL_NOT_LOSE;
+		proven = solver_run(&run, &cell);
+		if(proven < 0)
+			return 0;
+
+		if(proven)
+		{
+			result->value = SOLVER_DRAW;
+			result->distance = 0;
+			result->cell = cell;
+		}
+		else
+		{
+			// The longest loss: the opponent wins at an even ply, find the
+			// last bound the player to move can hold out to. When it can't
+			// even get past the second ply every move loses as quickly.
+			struct MoveList moveList;
+			put_moves_for_game(game, &moveList);
+			result->value = SOLVER_LOSS;
+			result->distance = maxPlies;
+			result->cell = get_move_cell(&moveList.moves[0]);
+			for(int maxPly = 2; maxPly <= maxPlies; maxPly += 2)
+			{
+				run.maxPly = maxPly;
+				proven = solver_run(&run, &cell);
+				if(proven < 0)
+					return 0;
+				if(!proven)
+				{
+					result->distance = maxPly;
+					break;
+				}
+				result->cell = cell;
+			}
+		}
+	}
+
+	// After the move the opponent is to move with the opposite result
+	solver_cache_store(game->hash, result->value, result->distance, result->cell);
+	struct Game next = *game;
+	play_cell(&next, result->cell);
+	solver_cache_store(next.hash, -result->value, result->distance > 0 ? result->distance - 1 : 0, 0xFF);
+	return 1;
+}
+
+// Scores of solver_negamax: a win scores this minus the plies to the end of
+// the game, a loss the negative of that, a draw 0
+#define NEGAMAX_WIN_SCORE 1000
+
+int negamax_run(struct Game* game, int ply, int alpha, int beta, unsigned int* nodes)
+{
+	(*nodes)++;
+	enum board_state winner = get_winning_player(game);
+	if(winner != UNDECIDED)
+	{
+		if(winner == DRAW)
+			return 0;
+		return winner == game->curPlayer ? NEGAMAX_WIN_SCORE - ply : ply - NEGAMAX_WIN_SCORE;
+	}
+
+	struct MoveList moveList;
+	put_moves_for_game(game, &moveList);
+	for(unsigned int i = 0; i < moveList.count && alpha < beta; i++)
+	{
+		do_move(game, &moveList.moves[i]);
+		int score = -negamax_run(game, ply + 1, -beta, -alpha, nodes);
+		undo_move(game, &moveList.moves[i]);
+
+		if(score > alpha)
+			alpha = score;
+	}
+	return alpha;
+}
+void solver_negamax(struct Game* game, struct SolverResult* result, unsigned int* nodes)
+{
+	// Alpha-beta with the full window at the root gives the exact score
+	int score = negamax_run(game, 0, -NEGAMAX_WIN_SCORE, NEGAMAX_WIN_SCORE, nodes);
+	result->value = score > 0 ? SOLVER_WIN : score < 0 ? SOLVER_LOSS : SOLVER_DRAW;
+	result->distance = score > 0 ? NEGAMAX_WIN_SCORE - score : score < 0 ? NEGAMAX_WIN_SCORE + score : 0;
+	result->cell = 0xFF;
+}
+
+int never_stop()
+{
+	return 0;
+}
+int solver_check(const struct SolverPosition* position, struct SolverResult* solved, struct SolverResult* negamax, unsigned int* nodes)
+{
+	// The solver has to find the known result, the negamax has to agree,
+	// and the move of the solver has to leave the opponent with the opposite
+	// result one ply closer to the end
+	if(!solverPool)
+		return 0;
+
+	struct Game game;
+	reset_game(&game);
+	play_moves(&game, position->moves);
+
+	solver_clear();
+	if(!solver_solve(&game, solved, never_stop, nodes))
+		return 0;
+	solver_negamax(&game, negamax, nodes);
+
+	struct SolverResult afterMove;
+	play_cell(&game, solved->cell);
+	solver_negamax(&game, &afterMove, nodes);
+	solver_clear();
+
+	return solved->value == position->value && solved->distance == position->distance
+		&& negamax->value == position->value && negamax->distance == position->distance
+		&& afterMove.value == -position->value && afterMove.distance == (position->distance > 0 ? position->distance - 1 : 0);
+}
+
+// The results were worked out with solver_negamax. The positions come from
+// random games and cover wins, losses and draws, short and long ones.
+const struct SolverPosition solverPositions[] =
+{
+	{ "win in 1", "36 62 24 49 95 57 71 19 91 12 27 74 44 42 29 92 25 53 39 99 97 75 52 21 17 73 35 55 61 18 84 43 38 82 22 28 83 37 72 26 64 41 16 69 94 86 66 68 85", SOLVER_WIN, 1 },
+	{ "win in 9", "53 35 55 57 77 72 27 74 49 99 93 38 82 29 97 73 31 18 84 44 45 51 12 26 65 56 69 95 59 92 22 21 19 96 66 63 32 25 58 81 13 33 39 94 48 87 76 67 75 54 47", SOLVER_WIN, 9 },
+	{ "loss in 6", "31 18 85 54 45 56 62 28 89 93 37 74 41 17 77 79 97 76 66 63 39 91 11 14 42 26 68 88 83 33 35 59 92 21 15 57 73 27 72 25 51 16 67 78 82 23 94 48 81 12 71 19 98", SOLVER_LOSS, 6 },
+	{ "loss in 8", "55 58 85 54 47 72 24 44 43 37 76 62 29 98 87 79 97 78 88 82 27 73 35 59 93 32 23 31 12 26 68 84 46 61 14 41 13 33 91 19 95 51 16 67 77 71 11 63", SOLVER_LOSS, 8 },
+	{ "draw, 20 cells", "81 16 61 14 42 27 72 24 47 74 41 12 26 62 21 15 57 77 73 34 45 53 36 65 54 49 99 95 51 68 89 93 33 31 88 85 22 23 37 76 46 44 48 84 97", SOLVER_DRAW, 0 },
+	{ "draw, 22 cells", "89 93 31 13 38 83 36 69 94 44 43 34 49 98 85 52 29 92 23 39 95 59 97 72 28 88 82 27 75 55 53 32 22 24 48 86 67 79 96 63 35 58 87 73 33 37 78 81 15 68 84 47 77", SOLVER_DRAW, 0 },
+};
+const size_t solverPositionCount = sizeof(solverPositions) / sizeof(solverPositions[0]);
@@ -0,0 +1,79 @@
+#ifndef SOLVER_H
+#define SOLVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "engine.h"
+
+/* Endgame solver: proof-number search that works out the exact result of a
+   position once few enough cells are left, instead of the estimate of the
+   search. search_game uses it on its own when useSolver is set.
+
+   A proof-number search only answers yes or no, so the solver asks in
+   turns whether the player to move wins, and if not whether they at least
+   draw. The number of plies the answer may take can be bounded, asking
+   again with smaller bounds gives the shortest win and the longest loss.
+
+   The tree nodes come from a pool in memory the platform provides, every
+   search starts with an empty pool. Solved positions are remembered, so
+   later moves of the same game and later searches of the same position
+   cost little or nothing. */
+
+// The solver takes over when the undecided boards have no more than this
+// many empty cells
+#define SOLVER_MAX_EMPTY_CELLS 24
+
+enum solver_value
+{
+	SOLVER_LOSS = -1,
+	SOLVER_DRAW = 0,
+	SOLVER_WIN = 1
+};
+
+struct SolverResult
+{
+	enum solver_value value;	// For the player to move
+	uint8_t distance;			// Plies until the game ends with the shortest win or longest loss
+	uint8_t cell;				// Move that gets that result
+};
+
+extern uint8_t useSolver;
+
+// Sets the memory of the node pool, returns 0 if it's too small
+int solver_set_memory(void* memory, size_t size);
+size_t solver_memory_size();
+
+// Whether the position is close enough to the end for the solver
+int solver_can_solve(struct Game* game);
+
+// Solves an undecided position. Returns 0 when it ran out of nodes or stop
+// returned 1, which is checked every so often. Every tree node adds one to
+// *nodes.
+int solver_solve(struct Game* game, struct SolverResult* result, int (*stop)(), unsigned int* nodes);
+
+// Forgets the solved positions
+void solver_clear();
+
+// Solves a position with a plain negamax over the whole game tree, without
+// a move. Only for checking the solver on small endgames.
+void solver_negamax(struct Game* game, struct SolverResult* result, unsigned int* nodes);
+
+// Endgames with known results to check the solver against, see
+// solver_negamax
+struct SolverPosition
+{
+	const char* name;
+	const char* moves;
+	enum solver_value value;
+	uint8_t distance;
+};
+extern const struct SolverPosition solverPositions[];
+extern const size_t solverPositionCount;
+
+// Solves one of solverPositions with the solver and with solver_negamax,
+// returns 1 when both get the known result and the move of the solver
+// keeps it. Every tree node of either adds one to *nodes.
+int solver_check(const struct SolverPosition* position, struct SolverResult* solved, struct SolverResult* negamax, unsigned int* nodes);
+
+#endif